@@ -0,0 +1,258 @@
+#include "AssetPack.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "KTXFile.h"
+
+namespace
+{
+  const char packMagic[8] = {'M', 'I', 'N', 'I', 'P', 'A', 'K', 0};
+
+  struct PackHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t entryCount;
+    uint64_t indexBytes;
+  };
+
+  // offset, size, nameLength; the name follows
+  const size_t indexEntryBytes = 8 + 8 + 4;
+
+  size_t alignUp(size_t n, size_t alignment)
+  {
+    return (n + alignment - 1) / alignment * alignment;
+  }
+
+  std::vector<std::string> defaultContents()
+  {
+    const char* directories[] = {"cube", "skybox", "skybox_righteye"};
+    const char* faces[] = {"left.ppm", "right.ppm", "up.ppm", "down.ppm", "back.ppm", "front.ppm"};
+    const char* shaders[] = {"sky.vert", "skybox.vert", "skybox.frag", "sphere.vert", "sphere.frag", "vertex_inputs.glsl", "stereo_eyes.glsl"};
+
+    std::vector<std::string> files;
+    for (const char* directory : directories)
+    {
+      // An eye baked as a stereo residual ships only the residual
+      MappedFile probe;
+      std::string residual = ktxPathFor(residualPathFor(directory));
+      if (probe.open(residual))
+      {
+        files.push_back(residual);
+        continue;
+      }
+      for (const char* face : faces)
+      {
+        files.push_back(std::string(directory) + "/" + face);
+      }
+      // Baked containers are optional
+      if (probe.open(ktxPathFor(directory)))
+      {
+        files.push_back(ktxPathFor(directory));
+      }
+    }
+    for (const char* shader : shaders)
+    {
+      files.push_back(shader);
+    }
+    return files;
+  }
+}
+
+std::string assetName(const std::string& path)
+{
+  std::string name;
+  for (char c : path)
+  {
+    c = c == '\\' ? '/' : c;
+    if (c == '/' && (name.empty() || name.back() == '/'))
+    {
+      continue;
+    }
+    name.push_back(c);
+    if (name == "./")
+    {
+      name.clear();
+    }
+    else if (name.size() > 2 && name.compare(name.size() - 3, 3, "/./") == 0)
+    {
+      name.resize(name.size() - 2);
+    }
+  }
+  return name;
+}
+
+bool AssetPack::mount(const std::string& path)
+{
+  std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+  if (!file->open(path))
+  {
+    return false;
+  }
+
+  PackHeader header;
+  if (file->size() < sizeof(header))
+  {
+    return false;
+  }
+  memcpy(&header, file->data(), sizeof(header));
+  if (memcmp(header.magic, packMagic, sizeof(packMagic)) != 0 || header.version != VERSION ||
+      header.indexBytes > file->size() - sizeof(header))
+  {
+    std::cerr << path << " is not a version " << VERSION << " asset pack" << std::endl;
+    return false;
+  }
+
+  std::vector<Entry> entries;
+  const unsigned char* index = file->data() + sizeof(header);
+  size_t pos = 0;
+  for (uint32_t i = 0; i < header.entryCount; i++)
+  {
+    uint64_t offset, size;
+    uint32_t nameLength;
+    if (pos + indexEntryBytes > header.indexBytes)
+    {
+      return false;
+    }
+    memcpy(&offset, index + pos, 8);
+    memcpy(&size, index + pos + 8, 8);
+    memcpy(&nameLength, index + pos + 16, 4);
+    pos += indexEntryBytes;
+    if (pos + nameLength > header.indexBytes || offset > file->size() || size > file->size() - offset)
+    {
+      std::cerr << path << " has a corrupt index" << std::endl;
+      return false;
+    }
+    entries.push_back(Entry{std::string(reinterpret_cast<const char*>(index + pos), nameLength), size_t(offset),
+                            size_t(size)});
+    pos += nameLength;
+  }
+  if (!std::is_sorted(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.name < b.name; }))
+  {
+    std::cerr << path << " has an unsorted index" << std::endl;
+    return false;
+  }
+
+  _file = file;
+  _entries.swap(entries);
+  return true;
+}
+
+bool AssetPack::find(const std::string& name, Asset& asset) const
+{
+  auto it = std::lower_bound(_entries.begin(), _entries.end(), name,
+                             [](const Entry& entry, const std::string& key) { return entry.name < key; });
+  if (it == _entries.end() || it->name != name)
+  {
+    return false;
+  }
+  asset.file = _file;
+  asset.data = _file->data() + it->offset;
+  asset.size = it->size;
+  return true;
+}
+
+AssetPack& AssetPack::shared()
+{
+  static AssetPack pack;
+  return pack;
+}
+
+bool openAsset(const std::string& path, Asset& asset)
+{
+  const AssetPack& pack = AssetPack::shared();
+  if (pack.isMounted() && pack.find(assetName(path), asset))
+  {
+    return true;
+  }
+
+  std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+  if (!file->open(path))
+  {
+    return false;
+  }
+  asset.file = file;
+  asset.data = file->data();
+  asset.size = file->size();
+  return true;
+}
+
+int packAssets(const std::string& output, std::vector<std::string> files)
+{
+  if (files.empty())
+  {
+    files = defaultContents();
+  }
+  for (std::string& file : files)
+  {
+    file = assetName(file);
+  }
+  std::sort(files.begin(), files.end());
+  files.erase(std::unique(files.begin(), files.end()), files.end());
+
+  std::vector<std::unique_ptr<MappedFile>> sources;
+  size_t indexBytes = 0;
+  for (const std::string& file : files)
+  {
+    sources.push_back(std::unique_ptr<MappedFile>(new MappedFile()));
+    if (!sources.back()->open(file))
+    {
+      std::cerr << "error packing " << file << ": could not open file" << std::endl;
+      return -1;
+    }
+    indexBytes += indexEntryBytes + file.size();
+  }
+
+  // Lay the payloads out on page boundaries after the index
+  std::vector<uint64_t> offsets;
+  size_t end = alignUp(sizeof(PackHeader) + indexBytes, AssetPack::ALIGNMENT);
+  for (const std::unique_ptr<MappedFile>& source : sources)
+  {
+    offsets.push_back(end);
+    end = alignUp(end + source->size(), AssetPack::ALIGNMENT);
+  }
+
+  std::ofstream out(output, std::ios::binary);
+  if (!out.is_open())
+  {
+    std::cerr << "error writing " << output << std::endl;
+    return -1;
+  }
+
+  PackHeader header = {};
+  memcpy(header.magic, packMagic, sizeof(packMagic));
+  header.version = AssetPack::VERSION;
+  header.entryCount = (uint32_t)files.size();
+  header.indexBytes = indexBytes;
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  for (size_t i = 0; i < files.size(); i++)
+  {
+    uint64_t size = sources[i]->size();
+    uint32_t nameLength = (uint32_t)files[i].size();
+    out.write(reinterpret_cast<const char*>(&offsets[i]), 8);
+    out.write(reinterpret_cast<const char*>(&size), 8);
+    out.write(reinterpret_cast<const char*>(&nameLength), 4);
+    out.write(files[i].data(), nameLength);
+  }
+
+  const std::vector<char> padding(AssetPack::ALIGNMENT, 0);
+  size_t written = sizeof(header) + indexBytes;
+  for (size_t i = 0; i < files.size(); i++)
+  {
+    out.write(padding.data(), offsets[i] - written);
+    out.write(reinterpret_cast<const char*>(sources[i]->data()), sources[i]->size());
+    written = offsets[i] + sources[i]->size();
+  }
+  out.write(padding.data(), end - written);
+  if (!out.good())
+  {
+    std::cerr << "error writing " << output << std::endl;
+    return -1;
+  }
+
+  std::cout << "Packed " << files.size() << " assets into " << output << " (" << end / 1024 << " KB)" << std::endl;
+  return 0;
+}
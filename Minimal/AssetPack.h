@@ -0,0 +1,67 @@
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+// The bytes of one asset, valid while 'file' (the pack or a loose file) is held
+struct Asset
+{
+  std::shared_ptr<MappedFile> file;
+  const unsigned char* data{nullptr};
+  size_t size{0};
+};
+
+// A single file holding many assets behind a name-sorted index. Every payload
+// starts on a page boundary, so the pack is mapped once and texture uploads
+// point straight into the mapping. Layout (little-endian):
+//
+//   header   "MINIPAK\0", uint32 version, uint32 entryCount, uint64 indexBytes
+//   index    entryCount x { uint64 offset, uint64 size, uint32 nameLength, name }
+//   payloads each aligned to ALIGNMENT
+class AssetPack
+{
+public:
+  static const unsigned int VERSION = 1;
+  static const size_t ALIGNMENT = 4096;
+
+  // Maps 'path' and reads its index; false if it is missing or malformed
+  bool mount(const std::string& path);
+  bool isMounted() const { return _file != nullptr; }
+  size_t entryCount() const { return _entries.size(); }
+
+  // Looks up a normalized asset name ("skybox/front.ppm")
+  bool find(const std::string& name, Asset& asset) const;
+
+  // The pack the loaders consult. Mount it before any loading starts; it is
+  // only read after that, so workers can use it without locking.
+  static AssetPack& shared();
+
+private:
+  struct Entry
+  {
+    std::string name;
+    size_t offset;
+    size_t size;
+  };
+
+  std::shared_ptr<MappedFile> _file;
+  std::vector<Entry> _entries;
+};
+
+// "./skybox//front.ppm" and ".\skybox\front.ppm" both become "skybox/front.ppm"
+std::string assetName(const std::string& path);
+
+// Finds 'path' in the mounted pack, falling back to mapping the loose file
+bool openAsset(const std::string& path, Asset& asset);
+
+// Packs 'files' (or, when empty, every cubemap face, baked .ktx and shader the
+// app loads; an eye baked as a stereo residual contributes only the residual)
+// into 'output'. Invoked as "Minimal.exe --pack <output> [files...]".
+// Returns 0 on success.
+int packAssets(const std::string& output, std::vector<std::string> files);
+
+#endif
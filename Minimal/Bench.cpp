@@ -0,0 +1,331 @@
+#include "Bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/gtc/matrix_transform.hpp>
+#include "BlockCompress.h"
+#include "CpuProfiler.h"
+#include "Culling.h"
+#include "Equirect.h"
+#include "MipGenerator.h"
+#include "PPMImage.h"
+#include "ThreadPool.h"
+
+namespace
+{
+  const char* cubemapDirs[] = {"cube", "skybox", "skybox_righteye"};
+  const char* cubemapFaces[] = {"left.ppm", "right.ppm", "up.ppm", "down.ppm", "back.ppm", "front.ppm"};
+
+  std::vector<std::string> allFacePaths()
+  {
+    std::vector<std::string> paths;
+    for (const char* dir : cubemapDirs)
+    {
+      for (const char* face : cubemapFaces)
+      {
+        paths.push_back(std::string("./") + dir + "/" + face);
+      }
+    }
+    return paths;
+  }
+
+  // Best of 'runs' wall-clock timings, in milliseconds
+  double timeBest(int runs, const std::function<void()>& body)
+  {
+    double best = 1e30;
+    for (int i = 0; i < runs; i++)
+    {
+      auto start = std::chrono::high_resolution_clock::now();
+      body();
+      auto end = std::chrono::high_resolution_clock::now();
+      best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+  }
+
+  int benchLoad()
+  {
+    std::vector<std::string> paths = allFacePaths();
+
+    double serial = timeBest(3, [&]
+    {
+      for (const std::string& path : paths)
+      {
+        PPMImage image;
+        if (decodePPM(path, image) != PPMError::None)
+        {
+          std::cerr << "failed to decode " << path << std::endl;
+        }
+      }
+    });
+
+    double parallel = timeBest(3, [&]
+    {
+      // Shared with the jobs, since a worker may still be inside push() after the last pop() returns
+      auto done = std::make_shared<ResultQueue<PPMError>>();
+      for (const std::string& path : paths)
+      {
+        ThreadPool::shared().submit([done, path]
+        {
+          PPMImage image;
+          done->push(decodePPM(path, image));
+        });
+      }
+      for (size_t i = 0; i < paths.size(); i++)
+      {
+        if (done->pop() != PPMError::None)
+        {
+          std::cerr << "failed to decode a face" << std::endl;
+        }
+      }
+    });
+
+    std::cout << "Decoded " << paths.size() << " faces" << std::endl;
+    std::cout << "  serial:   " << serial << " ms" << std::endl;
+    std::cout << "  parallel: " << parallel << " ms (" << ThreadPool::shared().size() << " workers)" << std::endl;
+    std::cout << "  speedup:  " << serial / parallel << "x" << std::endl;
+    std::cout << "Timings are best of 3 and include the OS file cache; flush it for cold-start numbers." << std::endl;
+    return 0;
+  }
+
+  int benchMips()
+  {
+    PPMImage image;
+    std::string path = "./skybox/front.ppm";
+    PPMError error = decodePPM(path, image);
+    if (error != PPMError::None)
+    {
+      std::cerr << "failed to decode " << path << ": " << describe(error) << std::endl;
+      return -1;
+    }
+
+    std::vector<MipLevel> reference, simd;
+    double scalar = timeBest(3, [&] { reference = generateMips(image.pixels, image.width, image.height, false); });
+    double vector = timeBest(3, [&] { simd = generateMips(image.pixels, image.width, image.height, true); });
+
+    // Both paths sum in the same order, so any difference is a bug in the SIMD code
+    size_t mismatched = 0;
+    for (size_t level = 0; level < reference.size(); level++)
+    {
+      for (size_t i = 0; i < reference[level].rgb.size(); i++)
+      {
+        mismatched += reference[level].rgb[i] != simd[level].rgb[i];
+      }
+    }
+
+    std::cout << "Generated " << reference.size() << " mip levels below " << image.width << "x" << image.height
+      << " (" << path << ")" << std::endl;
+    std::cout << "  scalar: " << scalar << " ms" << std::endl;
+    std::cout << "  simd:   " << vector << " ms" << std::endl;
+    std::cout << "  speedup: " << scalar / vector << "x, " << mismatched << " mismatched bytes" << std::endl;
+    return mismatched == 0 ? 0 : -1;
+  }
+
+  double psnr(const std::vector<unsigned char>& reference, const std::vector<unsigned char>& decoded)
+  {
+    double squared = 0.0;
+    for (size_t i = 0; i < reference.size(); i++)
+    {
+      double difference = double(reference[i]) - double(decoded[i]);
+      squared += difference * difference;
+    }
+    double mean = squared / std::max(reference.size(), size_t(1));
+    return mean > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mean) : 99.0;
+  }
+
+  int benchCompress()
+  {
+    // Lowest acceptable PSNR per format over these faces; the encoder gets
+    // about 31-33 dB (BC1) and 34-40 dB (BC7) on them
+    const double minimum[2] = {28.0, 31.0};
+    const BlockFormat formats[2] = {BlockFormat::BC1, BlockFormat::BC7};
+
+    int status = 0;
+    for (const char* dir : cubemapDirs)
+    {
+      PPMImage image;
+      std::string path = std::string("./") + dir + "/front.ppm";
+      PPMError error = decodePPM(path, image);
+      if (error != PPMError::None)
+      {
+        std::cerr << "failed to decode " << path << ": " << describe(error) << std::endl;
+        return -1;
+      }
+      std::vector<unsigned char> source(image.pixels, image.pixels + size_t(image.width) * image.height * 3);
+
+      std::cout << "Compressed " << image.width << "x" << image.height << " " << path << std::endl;
+      for (int f = 0; f < 2; f++)
+      {
+        std::vector<unsigned char> blocks, decoded;
+        double encode = timeBest(3, [&] { blocks = compressImage(image.pixels, image.width, image.height, formats[f]); });
+        bool complete = decompressImage(blocks.data(), image.width, image.height, formats[f], decoded);
+        double quality = psnr(source, decoded);
+        bool good = complete && quality >= minimum[f];
+        status = good ? status : -1;
+        std::cout << "  " << blockFormatName(formats[f]) << ": " << encode << " ms, " << quality << " dB PSNR"
+          << (good ? "" : complete ? " (BELOW " + std::to_string(int(minimum[f])) + " dB)" : " (UNDECODABLE BLOCKS)")
+          << std::endl;
+      }
+    }
+    return status;
+  }
+
+  int benchEquirect()
+  {
+    // A synthetic 8K-wide panorama with smooth detail everywhere, seams and poles included
+    const int width = 8192, height = 4096, faceSize = defaultFaceSize(width);
+    std::vector<unsigned char> panorama(size_t(width) * height * 3);
+    for (int y = 0; y < height; y++)
+    {
+      for (int x = 0; x < width; x++)
+      {
+        unsigned char* p = &panorama[(size_t(y) * width + x) * 3];
+        p[0] = (unsigned char)(127.5f + 127.5f * std::sin(x * 0.05f));
+        p[1] = (unsigned char)(127.5f + 127.5f * std::sin(y * 0.07f));
+        p[2] = (unsigned char)(127.5f + 127.5f * std::sin((x + y) * 0.03f));
+      }
+    }
+
+    std::vector<unsigned char> reference[6], simd[6];
+    double scalar = timeBest(3, [&] { equirectToCubemap(panorama.data(), width, height, faceSize, reference, false); });
+    double vector = timeBest(3, [&] { equirectToCubemap(panorama.data(), width, height, faceSize, simd, true); });
+
+    // The SIMD path uses a polynomial atan, so texels may round differently by one
+    int maxDifference = 0;
+    size_t differing = 0, total = 0;
+    for (int face = 0; face < 6; face++)
+    {
+      for (size_t i = 0; i < reference[face].size(); i++)
+      {
+        int difference = std::abs(int(reference[face][i]) - int(simd[face][i]));
+        maxDifference = std::max(maxDifference, difference);
+        differing += difference != 0;
+      }
+      total += reference[face].size();
+    }
+
+    std::cout << "Resampled a " << width << "x" << height << " panorama into six " << faceSize << "x" << faceSize
+      << " faces (" << ThreadPool::shared().size() << " workers)" << std::endl;
+    std::cout << "  scalar: " << scalar << " ms" << std::endl;
+    std::cout << "  simd:   " << vector << " ms" << std::endl;
+    std::cout << "  speedup: " << scalar / vector << "x, " << differing << " of " << total
+      << " bytes differ, by at most " << maxDifference << std::endl;
+    return maxDifference <= 1 ? 0 : -1;
+  }
+
+  int benchCull()
+  {
+    // Eyes 64mm apart with a wide, Rift-like field of view, looking into a
+    // field of boxes 10cm to 2m across scattered over 200m around them
+    glm::mat4 projection = glm::perspective(glm::radians(100.0f), 0.9f, 0.01f, 1000.0f);
+    glm::mat4 head = glm::rotate(glm::mat4(1.0f), 0.3f, glm::vec3(0.0f, 1.0f, 0.0f));
+    ViewFrustum eyes[2];
+    for (int eye = 0; eye < 2; eye++)
+    {
+      glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(eye == 0 ? 0.032f : -0.032f, 0.0f, 0.0f)) * head;
+      eyes[eye] = ViewFrustum::fromMatrix(projection * view);
+    }
+
+    int status = 0;
+    for (size_t count : {size_t(10000), size_t(100000), size_t(1000000)})
+    {
+      std::mt19937 random(1);
+      std::uniform_real_distribution<float> position(-100.0f, 100.0f), size(0.05f, 1.0f);
+      CullSet set;
+      for (size_t i = 0; i < count; i++)
+      {
+        BoundingBox bounds;
+        bounds.center = glm::vec3(position(random), position(random), position(random));
+        bounds.extent = glm::vec3(size(random), size(random), size(random));
+        set.add(bounds);
+      }
+
+      std::vector<uint32_t> perEye[2], scalar[2], simd[2];
+      double separate = timeBest(5, [&]
+      {
+        for (int eye = 0; eye < 2; eye++)
+        {
+          set.cull(&eyes[eye], 1, &perEye[eye], false);
+        }
+      });
+      double twoStage = timeBest(5, [&] { set.cull(eyes, 2, scalar, false); });
+      double vector = timeBest(5, [&] { set.cull(eyes, 2, simd, true); });
+
+      // Nothing the union rejects is visible to either eye, so all three must agree
+      bool match = true;
+      for (int eye = 0; eye < 2; eye++)
+      {
+        match = match && perEye[eye] == scalar[eye] && scalar[eye] == simd[eye];
+      }
+      status = match ? status : -1;
+
+      std::cout << "Culled " << count << " boxes for two eyes: " << set.candidates() << " in the union, "
+        << simd[0].size() << " and " << simd[1].size() << " per eye" << (match ? "" : " (MISMATCH)") << std::endl;
+      std::cout << "  each eye, scalar:  " << separate << " ms" << std::endl;
+      std::cout << "  two-stage, scalar: " << twoStage << " ms" << std::endl;
+      std::cout << "  two-stage, simd:   " << vector << " ms (" << separate / vector << "x)" << std::endl;
+    }
+    return status;
+  }
+
+  int benchProfile()
+  {
+    // Nested in pairs, as zones usually are; the buffer laps many times over
+    const int zones = 1000000;
+    double elapsed = timeBest(5, [&]
+    {
+      for (int i = 0; i < zones / 2; i++)
+      {
+        CpuZone outer("outer");
+        CpuZone inner("inner");
+      }
+    });
+    double perZone = elapsed * 1e6 / zones;
+
+    std::cout << "Recorded " << zones << " CPU zones" << (MINIMAL_PROFILE ? "" : " (PROFILE_ZONE is compiled out)")
+      << std::endl;
+    std::cout << "  " << elapsed << " ms, " << perZone << " ns per zone" << std::endl;
+    return perZone < 1000.0 ? 0 : -1;
+  }
+}
+
+int runBenchmark(const std::string& name)
+{
+  if (name == "load")
+  {
+    return benchLoad();
+  }
+  if (name == "mips")
+  {
+    return benchMips();
+  }
+  if (name == "equirect")
+  {
+    return benchEquirect();
+  }
+  if (name == "compress")
+  {
+    return benchCompress();
+  }
+  if (name == "cull")
+  {
+    return benchCull();
+  }
+  if (name == "profile")
+  {
+    return benchProfile();
+  }
+
+  std::cerr << "unknown benchmark: " << name << std::endl;
+  return -1;
+}
@@ -0,0 +1,10 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <string>
+
+// Runs one of the CPU-side benchmarks by name ("load", "mips", ...) and prints the
+// timings. Invoked as "Minimal.exe --bench <name>"; needs no HMD or GL context.
+int runBenchmark(const std::string& name);
+
+#endif
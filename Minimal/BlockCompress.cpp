@@ -0,0 +1,544 @@
+#include "BlockCompress.h"
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "ThreadPool.h"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+bool parseBlockFormat(const std::string& name, BlockFormat& format)
+{
+  if (name == "bc1")
+  {
+    format = BlockFormat::BC1;
+    return true;
+  }
+  if (name == "bc7")
+  {
+    format = BlockFormat::BC7;
+    return true;
+  }
+  return false;
+}
+
+const char* blockFormatName(BlockFormat format)
+{
+  return format == BlockFormat::BC1 ? "bc1" : "bc7";
+}
+
+size_t blockBytes(BlockFormat format)
+{
+  return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+unsigned int blockGLFormat(BlockFormat format)
+{
+  return format == BlockFormat::BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_BPTC_UNORM;
+}
+
+unsigned int blockGLBaseFormat(BlockFormat format)
+{
+  return format == BlockFormat::BC1 ? GL_RGB : GL_RGBA;
+}
+
+namespace
+{
+  struct Color
+  {
+    float r, g, b;
+  };
+
+  Color pixel(const unsigned char* rgb, int i)
+  {
+    return Color{float(rgb[i * 3]), float(rgb[i * 3 + 1]), float(rgb[i * 3 + 2])};
+  }
+
+  float distance2(const Color& a, const Color& b)
+  {
+    float dr = a.r - b.r, dg = a.g - b.g, db = a.b - b.b;
+    return dr * dr + dg * dg + db * db;
+  }
+
+  // Fits a line through the block's colors and returns its two extremes
+  void principalEndpoints(const unsigned char* rgb, Color& high, Color& low)
+  {
+    Color mean{0, 0, 0};
+    for (int i = 0; i < 16; i++)
+    {
+      Color c = pixel(rgb, i);
+      mean.r += c.r / 16.0f;
+      mean.g += c.g / 16.0f;
+      mean.b += c.b / 16.0f;
+    }
+
+    float cov[6] = {0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < 16; i++)
+    {
+      Color c = pixel(rgb, i);
+      float r = c.r - mean.r, g = c.g - mean.g, b = c.b - mean.b;
+      cov[0] += r * r;
+      cov[1] += r * g;
+      cov[2] += r * b;
+      cov[3] += g * g;
+      cov[4] += g * b;
+      cov[5] += b * b;
+    }
+
+    // A few power iterations are plenty for a 3x3 symmetric matrix
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+      float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+      float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+      float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+      float length = std::sqrt(x * x + y * y + z * z);
+      if (length < 1e-6f)
+      {
+        break;
+      }
+      axis[0] = x / length;
+      axis[1] = y / length;
+      axis[2] = z / length;
+    }
+
+    float minT = 0.0f, maxT = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+      Color c = pixel(rgb, i);
+      float t = (c.r - mean.r) * axis[0] + (c.g - mean.g) * axis[1] + (c.b - mean.b) * axis[2];
+      minT = std::min(minT, t);
+      maxT = std::max(maxT, t);
+    }
+    high = Color{mean.r + axis[0] * maxT, mean.g + axis[1] * maxT, mean.b + axis[2] * maxT};
+    low = Color{mean.r + axis[0] * minT, mean.g + axis[1] * minT, mean.b + axis[2] * minT};
+  }
+
+  // Least-squares endpoints for fixed per-pixel weights (the fraction of 'low')
+  bool refineEndpoints(const unsigned char* rgb, const float* weights, Color& high, Color& low)
+  {
+    float aa = 0, ab = 0, bb = 0;
+    Color ap{0, 0, 0}, bp{0, 0, 0};
+    for (int i = 0; i < 16; i++)
+    {
+      float b = weights[i], a = 1.0f - b;
+      Color c = pixel(rgb, i);
+      aa += a * a;
+      ab += a * b;
+      bb += b * b;
+      ap.r += a * c.r;
+      ap.g += a * c.g;
+      ap.b += a * c.b;
+      bp.r += b * c.r;
+      bp.g += b * c.g;
+      bp.b += b * c.b;
+    }
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1e-6f)
+    {
+      return false;
+    }
+    high = Color{(bb * ap.r - ab * bp.r) / det, (bb * ap.g - ab * bp.g) / det, (bb * ap.b - ab * bp.b) / det};
+    low = Color{(aa * bp.r - ab * ap.r) / det, (aa * bp.g - ab * ap.g) / det, (aa * bp.b - ab * ap.b) / det};
+    return true;
+  }
+
+  int quantize(float value, int maxValue)
+  {
+    int q = int(std::floor(value / 255.0f * maxValue + 0.5f));
+    return std::max(0, std::min(maxValue, q));
+  }
+
+  //////////////////////////////////////////////////////////////////////
+  // BC1
+
+  unsigned short pack565(const Color& c)
+  {
+    return (unsigned short)((quantize(c.r, 31) << 11) | (quantize(c.g, 63) << 5) | quantize(c.b, 31));
+  }
+
+  Color unpack565(unsigned short c)
+  {
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    return Color{float((r << 3) | (r >> 2)), float((g << 2) | (g >> 4)), float((b << 3) | (b >> 2))};
+  }
+
+  // Picks the nearest of the four palette entries for every pixel; returns the total error
+  float selectBC1(const unsigned char* rgb, unsigned short c0, unsigned short c1, unsigned int& indices)
+  {
+    Color p0 = unpack565(c0), p1 = unpack565(c1);
+    Color palette[4] = {
+      p0, p1,
+      Color{(2 * p0.r + p1.r) / 3, (2 * p0.g + p1.g) / 3, (2 * p0.b + p1.b) / 3},
+      Color{(p0.r + 2 * p1.r) / 3, (p0.g + 2 * p1.g) / 3, (p0.b + 2 * p1.b) / 3},
+    };
+
+    float total = 0.0f;
+    indices = 0;
+    for (int i = 0; i < 16; i++)
+    {
+      Color c = pixel(rgb, i);
+      int best = 0;
+      float bestError = distance2(c, palette[0]);
+      for (int p = 1; p < 4; p++)
+      {
+        float error = distance2(c, palette[p]);
+        if (error < bestError)
+        {
+          bestError = error;
+          best = p;
+        }
+      }
+      indices |= unsigned(best) << (2 * i);
+      total += bestError;
+    }
+    return total;
+  }
+
+  float encodeBC1(const unsigned char* rgb, const Color& high, const Color& low, unsigned short& c0,
+                  unsigned short& c1, unsigned int& indices)
+  {
+    c0 = pack565(high);
+    c1 = pack565(low);
+    // c0 > c1 selects the opaque four-color mode
+    if (c0 < c1)
+    {
+      std::swap(c0, c1);
+    }
+    if (c0 == c1)
+    {
+      indices = 0;
+      Color p = unpack565(c0);
+      float total = 0.0f;
+      for (int i = 0; i < 16; i++)
+      {
+        total += distance2(pixel(rgb, i), p);
+      }
+      return total;
+    }
+    return selectBC1(rgb, c0, c1, indices);
+  }
+
+  //////////////////////////////////////////////////////////////////////
+  // BC7 mode 6
+
+  const int bc7Weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+  struct BC7Endpoints
+  {
+    // 7-bit channel values; the p-bit is fixed to 1 so alpha decodes to 255
+    int high[3];
+    int low[3];
+  };
+
+  BC7Endpoints quantizeBC7(const Color& high, const Color& low)
+  {
+    BC7Endpoints e;
+    const float h[3] = {high.r, high.g, high.b}, l[3] = {low.r, low.g, low.b};
+    for (int c = 0; c < 3; c++)
+    {
+      e.high[c] = std::max(0, std::min(127, int(std::floor((h[c] - 1.0f) / 2.0f + 0.5f))));
+      e.low[c] = std::max(0, std::min(127, int(std::floor((l[c] - 1.0f) / 2.0f + 0.5f))));
+    }
+    return e;
+  }
+
+  float selectBC7(const unsigned char* rgb, const BC7Endpoints& e, unsigned char* indices)
+  {
+    int palette[16][3];
+    for (int w = 0; w < 16; w++)
+    {
+      for (int c = 0; c < 3; c++)
+      {
+        int a = (e.high[c] << 1) | 1, b = (e.low[c] << 1) | 1;
+        palette[w][c] = ((64 - bc7Weights[w]) * a + bc7Weights[w] * b + 32) >> 6;
+      }
+    }
+
+    float total = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+      int best = 0, bestError = 1 << 30;
+      for (int w = 0; w < 16; w++)
+      {
+        int dr = rgb[i * 3] - palette[w][0], dg = rgb[i * 3 + 1] - palette[w][1], db = rgb[i * 3 + 2] - palette[w][2];
+        int error = dr * dr + dg * dg + db * db;
+        if (error < bestError)
+        {
+          bestError = error;
+          best = w;
+        }
+      }
+      indices[i] = (unsigned char)best;
+      total += float(bestError);
+    }
+    return total;
+  }
+
+  class BitWriter
+  {
+  public:
+    explicit BitWriter(unsigned char* out) : _out(out) { memset(out, 0, 16); }
+
+    void write(unsigned int value, int bits)
+    {
+      for (int i = 0; i < bits; i++, _position++)
+      {
+        if (value & (1u << i))
+        {
+          _out[_position >> 3] |= (unsigned char)(1u << (_position & 7));
+        }
+      }
+    }
+
+  private:
+    unsigned char* _out;
+    int _position{0};
+  };
+
+  class BitReader
+  {
+  public:
+    explicit BitReader(const unsigned char* in) : _in(in) {}
+
+    unsigned int read(int bits)
+    {
+      unsigned int value = 0;
+      for (int i = 0; i < bits; i++, _position++)
+      {
+        value |= unsigned((_in[_position >> 3] >> (_position & 7)) & 1) << i;
+      }
+      return value;
+    }
+
+  private:
+    const unsigned char* _in;
+    int _position{0};
+  };
+}
+
+void encodeBC1Block(const unsigned char* rgb, unsigned char* out)
+{
+  Color high, low;
+  principalEndpoints(rgb, high, low);
+
+  unsigned short c0, c1;
+  unsigned int indices;
+  float error = encodeBC1(rgb, high, low, c0, c1, indices);
+
+  // One least-squares pass on the chosen indices usually tightens the endpoints
+  if (c0 != c1)
+  {
+    const float palettePosition[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+    float weights[16];
+    for (int i = 0; i < 16; i++)
+    {
+      weights[i] = palettePosition[(indices >> (2 * i)) & 3];
+    }
+    Color refinedHigh, refinedLow;
+    if (refineEndpoints(rgb, weights, refinedHigh, refinedLow))
+    {
+      unsigned short r0, r1;
+      unsigned int refinedIndices;
+      if (encodeBC1(rgb, refinedHigh, refinedLow, r0, r1, refinedIndices) < error)
+      {
+        c0 = r0;
+        c1 = r1;
+        indices = refinedIndices;
+      }
+    }
+  }
+
+  out[0] = (unsigned char)(c0 & 0xff);
+  out[1] = (unsigned char)(c0 >> 8);
+  out[2] = (unsigned char)(c1 & 0xff);
+  out[3] = (unsigned char)(c1 >> 8);
+  for (int i = 0; i < 4; i++)
+  {
+    out[4 + i] = (unsigned char)((indices >> (8 * i)) & 0xff);
+  }
+}
+
+void encodeBC7Block(const unsigned char* rgb, unsigned char* out)
+{
+  Color high, low;
+  principalEndpoints(rgb, high, low);
+
+  BC7Endpoints endpoints = quantizeBC7(high, low);
+  unsigned char indices[16];
+  float error = selectBC7(rgb, endpoints, indices);
+
+  float weights[16];
+  for (int i = 0; i < 16; i++)
+  {
+    weights[i] = bc7Weights[indices[i]] / 64.0f;
+  }
+  Color refinedHigh, refinedLow;
+  if (refineEndpoints(rgb, weights, refinedHigh, refinedLow))
+  {
+    BC7Endpoints refined = quantizeBC7(refinedHigh, refinedLow);
+    unsigned char refinedIndices[16];
+    if (selectBC7(rgb, refined, refinedIndices) < error)
+    {
+      endpoints = refined;
+      memcpy(indices, refinedIndices, sizeof(indices));
+    }
+  }
+
+  // The first index is stored with an implicit zero top bit, so flip the
+  // endpoints (and with them every index) if it would need one
+  if (indices[0] >= 8)
+  {
+    for (int c = 0; c < 3; c++)
+    {
+      std::swap(endpoints.high[c], endpoints.low[c]);
+    }
+    for (int i = 0; i < 16; i++)
+    {
+      indices[i] = (unsigned char)(15 - indices[i]);
+    }
+  }
+
+  BitWriter bits(out);
+  bits.write(1 << 6, 7); // mode 6
+  for (int c = 0; c < 3; c++)
+  {
+    bits.write(endpoints.high[c], 7);
+    bits.write(endpoints.low[c], 7);
+  }
+  bits.write(127, 7); // alpha
+  bits.write(127, 7);
+  bits.write(1, 1); // p-bits
+  bits.write(1, 1);
+  bits.write(indices[0], 3);
+  for (int i = 1; i < 16; i++)
+  {
+    bits.write(indices[i], 4);
+  }
+}
+
+bool decodeBC1Block(const unsigned char* in, unsigned char* rgb)
+{
+  unsigned short c0 = (unsigned short)(in[0] | (in[1] << 8)), c1 = (unsigned short)(in[2] | (in[3] << 8));
+  Color p0 = unpack565(c0), p1 = unpack565(c1);
+  Color palette[4] = {p0, p1};
+  if (c0 > c1)
+  {
+    palette[2] = Color{(2 * p0.r + p1.r) / 3, (2 * p0.g + p1.g) / 3, (2 * p0.b + p1.b) / 3};
+    palette[3] = Color{(p0.r + 2 * p1.r) / 3, (p0.g + 2 * p1.g) / 3, (p0.b + 2 * p1.b) / 3};
+  }
+  else
+  {
+    // The three-color mode; the fourth entry is transparent black
+    palette[2] = Color{(p0.r + p1.r) / 2, (p0.g + p1.g) / 2, (p0.b + p1.b) / 2};
+    palette[3] = Color{0, 0, 0};
+  }
+  unsigned int indices = in[4] | (in[5] << 8) | (in[6] << 16) | (unsigned(in[7]) << 24);
+  for (int i = 0; i < 16; i++)
+  {
+    const Color& c = palette[(indices >> (2 * i)) & 3];
+    rgb[i * 3] = (unsigned char)(c.r + 0.5f);
+    rgb[i * 3 + 1] = (unsigned char)(c.g + 0.5f);
+    rgb[i * 3 + 2] = (unsigned char)(c.b + 0.5f);
+  }
+  return true;
+}
+
+bool decodeBC7Block(const unsigned char* in, unsigned char* rgb)
+{
+  BitReader bits(in);
+  if (bits.read(7) != 1 << 6)
+  {
+    memset(rgb, 0, 16 * 3);
+    return false;
+  }
+  int high[3], low[3];
+  for (int c = 0; c < 3; c++)
+  {
+    high[c] = bits.read(7) << 1;
+    low[c] = bits.read(7) << 1;
+  }
+  bits.read(14); // alpha
+  int pHigh = bits.read(1), pLow = bits.read(1);
+  for (int i = 0; i < 16; i++)
+  {
+    int index = bits.read(i == 0 ? 3 : 4);
+    for (int c = 0; c < 3; c++)
+    {
+      int a = high[c] | pHigh, b = low[c] | pLow;
+      rgb[i * 3 + c] = (unsigned char)(((64 - bc7Weights[index]) * a + bc7Weights[index] * b + 32) >> 6);
+    }
+  }
+  return true;
+}
+
+bool decompressImage(const unsigned char* blocks, int width, int height, BlockFormat format,
+                     std::vector<unsigned char>& rgb)
+{
+  const int blocksWide = (width + 3) / 4;
+  const int blocksHigh = (height + 3) / 4;
+  const size_t bytesPerBlock = blockBytes(format);
+  rgb.assign(size_t(width) * height * 3, 0);
+
+  bool decoded = true;
+  for (int by = 0; by < blocksHigh; by++)
+  {
+    for (int bx = 0; bx < blocksWide; bx++)
+    {
+      const unsigned char* in = blocks + (size_t(by) * blocksWide + bx) * bytesPerBlock;
+      unsigned char block[16 * 3];
+      decoded = (format == BlockFormat::BC1 ? decodeBC1Block(in, block) : decodeBC7Block(in, block)) && decoded;
+      // The padding compressImage added is dropped again
+      for (int y = 0; y < 4 && by * 4 + y < height; y++)
+      {
+        for (int x = 0; x < 4 && bx * 4 + x < width; x++)
+        {
+          memcpy(&rgb[(size_t(by * 4 + y) * width + bx * 4 + x) * 3], block + (y * 4 + x) * 3, 3);
+        }
+      }
+    }
+  }
+  return decoded;
+}
+
+std::vector<unsigned char> compressImage(const unsigned char* rgb, int width, int height, BlockFormat format)
+{
+  const int blocksWide = (width + 3) / 4;
+  const int blocksHigh = (height + 3) / 4;
+  const size_t bytesPerBlock = blockBytes(format);
+  std::vector<unsigned char> blocks(size_t(blocksWide) * blocksHigh * bytesPerBlock);
+
+  parallelFor(blocksHigh, [&](size_t by)
+  {
+    unsigned char block[16 * 3];
+    for (int bx = 0; bx < blocksWide; bx++)
+    {
+      for (int y = 0; y < 4; y++)
+      {
+        int sy = std::min(int(by) * 4 + y, height - 1);
+        for (int x = 0; x < 4; x++)
+        {
+          int sx = std::min(bx * 4 + x, width - 1);
+          memcpy(block + (y * 4 + x) * 3, rgb + (size_t(sy) * width + sx) * 3, 3);
+        }
+      }
+      unsigned char* out = blocks.data() + (by * blocksWide + bx) * bytesPerBlock;
+      if (format == BlockFormat::BC1)
+      {
+        encodeBC1Block(block, out);
+      }
+      else
+      {
+        encodeBC7Block(block, out);
+      }
+    }
+  });
+
+  return blocks;
+}
@@ -0,0 +1,42 @@
+#ifndef BLOCKCOMPRESS_H
+#define BLOCKCOMPRESS_H
+
+#include <string>
+#include <vector>
+
+enum class BlockFormat
+{
+  BC1, // 4 bpp, RGB 5:6:5 endpoints with 4 interpolated colors
+  BC7, // 8 bpp, mode 6 only: RGBA 7.1 endpoints with 16 interpolated colors
+};
+
+bool parseBlockFormat(const std::string& name, BlockFormat& format);
+const char* blockFormatName(BlockFormat format);
+size_t blockBytes(BlockFormat format);
+
+// GL internal format the blocks are uploaded with
+unsigned int blockGLFormat(BlockFormat format);
+// Base format of that internal format, as KTX's glBaseInternalFormat wants it
+unsigned int blockGLBaseFormat(BlockFormat format);
+
+// Encodes one 4x4 block of RGB pixels, 'rgb' holding 16 pixels in row order
+void encodeBC1Block(const unsigned char* rgb, unsigned char* out);
+void encodeBC7Block(const unsigned char* rgb, unsigned char* out);
+
+// Compresses a whole tightly packed RGB image. Partial blocks at the right and
+// bottom edges (and images smaller than a block) are padded by repeating the
+// last row and column. Rows of blocks are encoded in parallel.
+std::vector<unsigned char> compressImage(const unsigned char* rgb, int width, int height, BlockFormat format);
+
+// The reverse, into 16 RGB pixels in row order, as a GPU would sample them.
+// Only BC7 mode 6, the one mode the encoder writes, is understood; a block in
+// any other mode decodes to black and returns false.
+bool decodeBC1Block(const unsigned char* in, unsigned char* rgb);
+bool decodeBC7Block(const unsigned char* in, unsigned char* rgb);
+
+// Decodes a compressImage() result back to a tightly packed RGB image, for
+// checking the encoder's quality. False if any block could not be decoded.
+bool decompressImage(const unsigned char* blocks, int width, int height, BlockFormat format,
+                     std::vector<unsigned char>& rgb);
+
+#endif
@@ -0,0 +1,155 @@
+#include "CpuProfiler.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+  // Guards the list of thread buffers, which only changes when a thread first records
+  std::mutex registryMutex;
+
+  // Trace timestamps are microseconds since startup
+  const uint64_t epoch = CpuProfiler::now();
+
+  void writeString(std::ostream& out, const char* text)
+  {
+    out << '"';
+    for (const char* c = text; *c; c++)
+    {
+      if (*c == '"' || *c == '\\')
+      {
+        out << '\\';
+      }
+      out << *c;
+    }
+    out << '"';
+  }
+
+  double microseconds(uint64_t nanoseconds)
+  {
+    return nanoseconds < epoch ? 0.0 : (nanoseconds - epoch) / 1000.0;
+  }
+}
+
+uint64_t CpuProfiler::now()
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::vector<CpuProfiler::ThreadBuffer*>& CpuProfiler::threads()
+{
+  static std::vector<ThreadBuffer*> buffers;
+  return buffers;
+}
+
+CpuProfiler::ThreadBuffer& CpuProfiler::threadBuffer()
+{
+  thread_local ThreadBuffer* buffer = nullptr;
+  if (!buffer)
+  {
+    buffer = new ThreadBuffer();
+    std::lock_guard<std::mutex> lock(registryMutex);
+    buffer->id = (unsigned int)threads().size() + 1;
+    buffer->name = "thread " + std::to_string(buffer->id);
+    threads().push_back(buffer);
+  }
+  return *buffer;
+}
+
+void CpuProfiler::record(const Event& event)
+{
+  // Only this thread writes the buffer, so the count needs no read-modify-write
+  ThreadBuffer& buffer = threadBuffer();
+  uint64_t index = buffer.written.load(std::memory_order_relaxed);
+  buffer.events[index % CAPACITY] = event;
+  buffer.written.store(index + 1, std::memory_order_release);
+}
+
+void CpuProfiler::zone(const char* name, uint64_t begin, uint64_t end)
+{
+  record(Event{name, begin, end, NO_FRAME});
+}
+
+void CpuProfiler::frameMark(unsigned int frame)
+{
+  uint64_t time = now();
+  record(Event{"frame", time, time, frame});
+}
+
+void CpuProfiler::nameThread(const std::string& name)
+{
+  ThreadBuffer& buffer = threadBuffer();
+  std::lock_guard<std::mutex> lock(registryMutex);
+  buffer.name = name;
+}
+
+bool CpuProfiler::writeTrace(const std::string& path)
+{
+  std::ofstream out(path);
+  if (!out)
+  {
+    return false;
+  }
+  out << std::fixed << std::setprecision(3);
+  out << "{\"traceEvents\":[\n";
+
+  std::lock_guard<std::mutex> lock(registryMutex);
+  bool first = true;
+  auto separate = [&]
+  {
+    out << (first ? "" : ",\n");
+    first = false;
+  };
+  std::vector<Event> events;
+  for (const ThreadBuffer* thread : threads())
+  {
+    const ThreadBuffer& buffer = *thread;
+    separate();
+    out << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer.id << ",\"name\":\"thread_name\",\"args\":{\"name\":";
+    writeString(out, buffer.name.c_str());
+    out << "}}";
+
+    // Copy what has been published, then drop whatever the thread may have
+    // lapped while the copy was being made
+    uint64_t written = buffer.written.load(std::memory_order_acquire);
+    uint64_t start = written > CAPACITY ? written - CAPACITY : 0;
+    events.clear();
+    for (uint64_t index = start; index < written; index++)
+    {
+      events.push_back(buffer.events[index % CAPACITY]);
+    }
+    // Orders the copies before the recount. The thread may already be
+    // writing slot 'after', which holds event after - CAPACITY, so that one
+    // goes too.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = buffer.written.load(std::memory_order_relaxed);
+    uint64_t valid = after + 1 > CAPACITY ? after + 1 - CAPACITY : 0;
+    size_t skip = valid > start ? (size_t)(valid - start) : 0;
+
+    for (size_t i = skip; i < events.size(); i++)
+    {
+      const Event& event = events[i];
+      separate();
+      if (event.frame == NO_FRAME)
+      {
+        out << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer.id << ",\"ts\":" << microseconds(event.begin)
+            << ",\"dur\":" << (event.end - event.begin) / 1000.0 << ",\"name\":";
+        writeString(out, event.name);
+        out << "}";
+      }
+      else
+      {
+        out << "{\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":" << buffer.id << ",\"ts\":" << microseconds(event.begin)
+            << ",\"name\":";
+        writeString(out, event.name);
+        out << ",\"args\":{\"frame\":" << event.frame << "}}";
+      }
+    }
+  }
+  out << "\n]}\n";
+  return bool(out);
+}
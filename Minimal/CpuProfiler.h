@@ -0,0 +1,91 @@
+#ifndef CPUPROFILER_H
+#define CPUPROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Set to 0 to compile every PROFILE_* macro out to nothing
+#ifndef MINIMAL_PROFILE
+#define MINIMAL_PROFILE 1
+#endif
+
+// Records timed CPU zones and frame markers and writes them out as Chrome
+// trace-event JSON, which chrome://tracing and Perfetto load. Each thread
+// writes into a buffer of its own, made on its first event and never freed,
+// so recording takes no lock: it reads the clock, fills a slot and publishes
+// it with one atomic store. A buffer keeps the last CAPACITY events of its
+// thread. Zone names must outlive the profiler (string literals, in practice).
+class CpuProfiler
+{
+public:
+  static const unsigned int CAPACITY = 1 << 15;
+
+  // Nanoseconds on a steady clock
+  static uint64_t now();
+
+  static void zone(const char* name, uint64_t begin, uint64_t end);
+  // Marks the start of 'frame' on the calling thread
+  static void frameMark(unsigned int frame);
+  // Names the calling thread in the trace
+  static void nameThread(const std::string& name);
+
+  // Writes every thread's buffered events; false if 'path' can't be written.
+  // Safe while other threads record: an event overwritten as it is copied
+  // is left out.
+  static bool writeTrace(const std::string& path);
+
+private:
+  struct Event
+  {
+    const char* name;
+    uint64_t begin, end;
+    unsigned int frame; // NO_FRAME for zones
+  };
+
+  static const unsigned int NO_FRAME = ~0u;
+
+  struct ThreadBuffer
+  {
+    Event events[CAPACITY];
+    std::atomic<uint64_t> written{0};
+    unsigned int id{0};
+    std::string name;
+  };
+
+  // Every thread's buffer, in the order they were made
+  static std::vector<ThreadBuffer*>& threads();
+  static ThreadBuffer& threadBuffer();
+  static void record(const Event& event);
+};
+
+// Times its own lifetime as 'name'
+class CpuZone
+{
+public:
+  explicit CpuZone(const char* name) : _name(name), _begin(CpuProfiler::now()) {}
+  ~CpuZone() { CpuProfiler::zone(_name, _begin, CpuProfiler::now()); }
+
+  CpuZone(const CpuZone&) = delete;
+  CpuZone& operator=(const CpuZone&) = delete;
+
+private:
+  const char* _name;
+  uint64_t _begin;
+};
+
+#if MINIMAL_PROFILE
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+// Times the rest of the enclosing block
+#define PROFILE_ZONE(name) CpuZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FRAME(frame) CpuProfiler::frameMark(frame)
+#define PROFILE_THREAD(name) CpuProfiler::nameThread(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_FRAME(frame) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
+
+#endif
@@ -14,6 +14,7 @@
 #endif
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include "ProgramReflection.h"
 
 class Cube {
 public:
@@ -26,9 +27,11 @@ public:
   void update();
   void spin(float);
 
-  // These variables are needed for the shader program
-  GLuint vertexBuffer, normalBuffer, VAO;
-  GLuint uProjection, uModelview;
+  // Reads the shared CubeMesh
+  GLuint VAO;
+  // Uniform locations, resolved once for the program they were last drawn with
+  GLuint uniformProgram{0};
+  UniformHandle<glm::mat4> uProjection, uModelview;
 };
 
 #endif
@@ -0,0 +1,108 @@
+#include "CubeMesh.h"
+
+#include <cstddef>
+
+namespace
+{
+  struct Face
+  {
+    GLfloat normal[3];
+    GLfloat up[3];
+  };
+
+  // In the order the old unindexed cube listed them
+  const Face cubeFaces[] = {
+    {{0.0f, 0.0f, -1.0f}, {0.0f, 1.0f, 0.0f}},
+    {{-1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}},
+    {{1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}},
+    {{0.0f, 0.0f, 1.0f}, {0.0f, 1.0f, 0.0f}},
+    {{0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+    {{0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+  };
+
+  // Upload into a buffer that is never written again
+  void uploadImmutable(GLenum target, GLsizeiptr size, const void* data)
+  {
+    if (GLEW_ARB_buffer_storage)
+    {
+      glBufferStorage(target, size, data, 0);
+    }
+    else
+    {
+      glBufferData(target, size, data, GL_STATIC_DRAW);
+    }
+  }
+}
+
+void buildCubeMesh(std::vector<MeshVertex>& vertices, std::vector<GLushort>& indices)
+{
+  vertices.clear();
+  indices.clear();
+  const GLfloat corners[4][2] = {{-1.0f, -1.0f}, {1.0f, -1.0f}, {1.0f, 1.0f}, {-1.0f, 1.0f}};
+  for (const Face& face : cubeFaces)
+  {
+    const GLfloat* n = face.normal;
+    const GLfloat* u = face.up;
+    // right = normal x up, so (right, up) turns counter-clockwise seen from inside
+    const GLfloat r[3] = {n[1] * u[2] - n[2] * u[1], n[2] * u[0] - n[0] * u[2], n[0] * u[1] - n[1] * u[0]};
+
+    GLushort first = (GLushort)vertices.size();
+    for (const GLfloat* corner : corners)
+    {
+      MeshVertex vertex;
+      for (int i = 0; i < 3; i++)
+      {
+        vertex.position[i] = n[i] + corner[0] * r[i] + corner[1] * u[i];
+        vertex.normal[i] = n[i];
+      }
+      vertex.uv[0] = (corner[0] + 1.0f) * 0.5f;
+      vertex.uv[1] = (corner[1] + 1.0f) * 0.5f;
+      vertices.push_back(vertex);
+    }
+    const GLushort quad[] = {0, 1, 2, 0, 2, 3};
+    for (GLushort index : quad)
+    {
+      indices.push_back(first + index);
+    }
+  }
+}
+
+CubeMesh::CubeMesh()
+{
+  std::vector<MeshVertex> vertices;
+  std::vector<GLushort> indices;
+  buildCubeMesh(vertices, indices);
+  _indexCount = (GLsizei)indices.size();
+
+  glGenBuffers(1, &_vertexBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
+  uploadImmutable(GL_ARRAY_BUFFER, vertices.size() * sizeof(MeshVertex), vertices.data());
+
+  // Filled through the array target: the element array binding belongs to
+  // whatever VAO is bound, and there may not be one
+  glGenBuffers(1, &_indexBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, _indexBuffer);
+  uploadImmutable(GL_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data());
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void CubeMesh::bindAttributes() const
+{
+  glBindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
+  // Each attribute reads its own offset within the interleaved vertex
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (GLvoid*)offsetof(MeshVertex, position));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (GLvoid*)offsetof(MeshVertex, normal));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (GLvoid*)offsetof(MeshVertex, uv));
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  // Unlike the array buffer, this binding is recorded in the VAO itself
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
+}
+
+const CubeMesh& CubeMesh::shared()
+{
+  static CubeMesh mesh;
+  return mesh;
+}
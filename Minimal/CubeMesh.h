@@ -0,0 +1,46 @@
+#ifndef CUBEMESH_H
+#define CUBEMESH_H
+
+#include <GL/glew.h>
+#include <vector>
+
+// One vertex of the interleaved cube mesh
+struct MeshVertex
+{
+  GLfloat position[3];
+  GLfloat normal[3];
+  GLfloat uv[2];
+};
+
+// The [-1, 1] cube as 24 vertices, four per face so each face carries its own
+// normal and uvs, and 36 indices. Triangles wind counter-clockwise seen from
+// inside the cube, which is the side the skybox is looked at from.
+void buildCubeMesh(std::vector<MeshVertex>& vertices, std::vector<GLushort>& indices);
+
+// The cube mesh in one vertex and one index buffer, uploaded once and shared by
+// every Cube. Each cube keeps only its own VAO.
+class CubeMesh
+{
+public:
+  CubeMesh();
+
+  CubeMesh(const CubeMesh&) = delete;
+  CubeMesh& operator=(const CubeMesh&) = delete;
+
+  // Points position (0), normal (1) and uv (2) of the bound VAO at the vertex
+  // buffer and gives it the index buffer
+  void bindAttributes() const;
+
+  GLsizei indexCount() const { return _indexCount; }
+
+  // Built on first use, on the GL thread. Like the programs, it lives as long
+  // as the process, so the buffers are never deleted.
+  static const CubeMesh& shared();
+
+private:
+  GLuint _vertexBuffer{0};
+  GLuint _indexBuffer{0};
+  GLsizei _indexCount{0};
+};
+
+#endif
@@ -0,0 +1,105 @@
+#include "Cubemap.h"
+
+#include <algorithm>
+
+Cubemap::Cubemap(GLuint placeholder) : placeholder(placeholder)
+{
+}
+
+Cubemap* Cubemap::fromTexture(GLuint texture)
+{
+  Cubemap* cubemap = new Cubemap();
+  cubemap->resident.texture = texture;
+  cubemap->ready = true;
+  return cubemap;
+}
+
+Cubemap::~Cubemap()
+{
+  resident.release();
+  incoming.release();
+}
+
+void Cubemap::promote()
+{
+  resident.release();
+  resident = incoming;
+  incoming = CubemapStorage();
+  ready = resident.texture != 0;
+}
+
+void Cubemap::evict()
+{
+  resident.release();
+  ready = false;
+}
+
+size_t CubemapStorage::bytes() const
+{
+  if (!texture)
+  {
+    return 0;
+  }
+  size_t total = 0;
+  for (int level = 0; level < levels; level++)
+  {
+    size_t levelSize = std::max(1, size >> level);
+    size_t blocks = ((levelSize + 3) / 4) * ((levelSize + 3) / 4);
+    switch (internalFormat)
+    {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+      total += blocks * 8;
+      break;
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+      total += blocks * 16;
+      break;
+    default:
+      total += levelSize * levelSize * 3;
+      break;
+    }
+  }
+  return total * 6;
+}
+
+void CubemapStorage::release()
+{
+  if (texture)
+  {
+    glDeleteTextures(1, &texture);
+  }
+  *this = CubemapStorage();
+}
+
+void setCubemapParameters(int levels)
+{
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+}
+
+void uploadKTX(const KTXCubemap& ktx, int baseLevel)
+{
+  // KTX rows are padded to 4 bytes, which is also GL's default unpack alignment
+  for (int level = baseLevel; level < ktx.levels; level++)
+  {
+    int levelSize = std::max(1, ktx.size >> level);
+    for (int face = 0; face < 6; face++)
+    {
+      const KTXCubemap::Image& image = ktx.image(level, face);
+      if (ktx.compressed())
+      {
+        glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level - baseLevel, ktx.glInternalFormat, levelSize,
+                               levelSize, 0, (GLsizei)image.bytes, image.data);
+      }
+      else
+      {
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level - baseLevel, ktx.glInternalFormat, levelSize, levelSize,
+                     0, ktx.glFormat, ktx.glType, image.data);
+      }
+    }
+  }
+  setCubemapParameters(ktx.levels - baseLevel);
+}
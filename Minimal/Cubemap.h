@@ -0,0 +1,93 @@
+#ifndef CUBEMAP_H
+#define CUBEMAP_H
+
+#include <GL/glew.h>
+#include <memory>
+#include <string>
+#include "KTXFile.h"
+
+// One GL cubemap texture holding levels [baseLevel, baseLevel + levels) of the
+// source's mip chain. baseLevel is above 0 once the top mips have been dropped.
+struct CubemapStorage
+{
+  GLuint texture{0};
+  GLenum internalFormat{GL_RGB8};
+  int size{0}; // of texture level 0
+  int levels{0};
+  int baseLevel{0};
+
+  size_t bytes() const;
+  void release();
+};
+
+// A cubemap texture that may still be streaming in. Until every face has been
+// uploaded, draws bind the placeholder instead of the partially filled texture.
+// A loaded cubemap can be refilled at a different resolution: the streamer
+// writes into 'incoming' while draws keep sampling 'resident', and the two are
+// swapped once the new texture is complete.
+class Cubemap
+{
+public:
+  explicit Cubemap(GLuint placeholder = 0);
+  // Wraps a texture that is already complete and takes ownership of it
+  static Cubemap* fromTexture(GLuint texture);
+  ~Cubemap();
+
+  Cubemap(const Cubemap&) = delete;
+  Cubemap& operator=(const Cubemap&) = delete;
+
+  // Also records the use for the residency manager
+  GLuint textureForDraw() const
+  {
+    if (alias)
+    {
+      return alias->textureForDraw();
+    }
+    used = true;
+    return ready ? resident.texture : placeholder;
+  }
+
+  // The cubemap that actually holds the texture: this one, or what it aliases
+  const Cubemap& owner() const { return alias ? alias->owner() : *this; }
+
+  // Drawable at full resolution with nothing left to stream
+  bool complete() const { return ready && !reduced && !streaming(); }
+
+  bool streaming() const { return pendingDecodes > 0 || pendingUploads > 0; }
+
+  // Bytes of texture memory owned by this cubemap (0 for an alias)
+  size_t residentBytes() const { return resident.bytes() + incoming.bytes(); }
+
+  // Makes the completely uploaded 'incoming' texture the one that draws
+  void promote();
+  // Frees the texture; draws fall back to the placeholder
+  void evict();
+
+  std::string source;
+  // Face size to resample an equirectangular source to; 0 picks defaultFaceSize
+  int faceSize{0};
+  CubemapStorage resident;
+  CubemapStorage incoming;
+  GLuint placeholder{0};
+  unsigned int pendingDecodes{0};
+  unsigned int pendingUploads{0};
+  bool ready{false};
+  // Residency bookkeeping: 'used' is set by textureForDraw and collected once
+  // per frame, 'reduced' marks a texture to bring back to full size when drawn
+  mutable bool used{false};
+  unsigned int lastUsedFrame{0};
+  bool reduced{false};
+  // Set when the same content is already loaded under another path; this
+  // cubemap then never allocates a texture of its own
+  std::shared_ptr<Cubemap> alias;
+};
+
+// Uploads every level and face of 'ktx' from 'baseLevel' down into the bound
+// GL_TEXTURE_CUBE_MAP and sets up trilinear filtering over the chain
+void uploadKTX(const KTXCubemap& ktx, int baseLevel = 0);
+
+// Sampler state shared by every cubemap: clamped edges, and trilinear
+// filtering when there is more than one level
+void setCubemapParameters(int levels);
+
+#endif
@@ -0,0 +1,252 @@
+#include "Culling.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULL_SSE2 1
+#endif
+
+namespace
+{
+  // A plane split into what the box test needs: the normal, its absolute
+  // value (which projects the half extents onto it) and the offset
+  struct PlaneTest
+  {
+    float nx, ny, nz, ax, ay, az, d;
+  };
+
+  void planeTests(const ViewFrustum& frustum, PlaneTest tests[6])
+  {
+    for (int p = 0; p < 6; p++)
+    {
+      const glm::vec4& plane = frustum.planes[p];
+      tests[p] = PlaneTest{plane[0], plane[1], plane[2], std::fabs(plane[0]), std::fabs(plane[1]), std::fabs(plane[2]),
+                           plane[3]};
+    }
+  }
+
+  // Entirely on the outside of the plane: even the box's innermost corner is behind it
+  inline bool outside(const PlaneTest& t, float cx, float cy, float cz, float ex, float ey, float ez)
+  {
+    float distance = t.nx * cx + t.ny * cy + t.nz * cz + t.d;
+    float reach = t.ax * ex + t.ay * ey + t.az * ez;
+    return distance + reach < 0.0f;
+  }
+
+#ifdef CULL_SSE2
+  struct PlaneTest4
+  {
+    __m128 nx, ny, nz, ax, ay, az, d;
+  };
+
+  void broadcast(const PlaneTest tests[6], PlaneTest4 wide[6])
+  {
+    for (int p = 0; p < 6; p++)
+    {
+      const PlaneTest& t = tests[p];
+      wide[p] = PlaneTest4{_mm_set1_ps(t.nx), _mm_set1_ps(t.ny), _mm_set1_ps(t.nz), _mm_set1_ps(t.ax),
+                           _mm_set1_ps(t.ay), _mm_set1_ps(t.az), _mm_set1_ps(t.d)};
+    }
+  }
+
+  // outside() for four boxes, summed in the same order so the lanes match the scalar test
+  inline __m128 outside4(const PlaneTest4& t, __m128 cx, __m128 cy, __m128 cz, __m128 ex, __m128 ey, __m128 ez)
+  {
+    __m128 distance = _mm_add_ps(
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(t.nx, cx), _mm_mul_ps(t.ny, cy)), _mm_mul_ps(t.nz, cz)), t.d);
+    __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(t.ax, ex), _mm_mul_ps(t.ay, ey)), _mm_mul_ps(t.az, ez));
+    return _mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps());
+  }
+#endif
+}
+
+float BoundingBox::radius() const
+{
+  return std::sqrt(extent.x * extent.x + extent.y * extent.y + extent.z * extent.z);
+}
+
+BoundingBox BoundingBox::transformed(const BoundingBox& local, const glm::mat4& transform)
+{
+  // Each world axis spans the absolute projections of the three local half extents
+  BoundingBox world;
+  float center[3], extent[3];
+  const float localCenter[3] = {local.center.x, local.center.y, local.center.z};
+  const float localExtent[3] = {local.extent.x, local.extent.y, local.extent.z};
+  for (int row = 0; row < 3; row++)
+  {
+    center[row] = transform[3][row];
+    extent[row] = 0.0f;
+    for (int column = 0; column < 3; column++)
+    {
+      center[row] += transform[column][row] * localCenter[column];
+      extent[row] += std::fabs(transform[column][row]) * localExtent[column];
+    }
+  }
+  world.center = glm::vec3(center[0], center[1], center[2]);
+  world.extent = glm::vec3(extent[0], extent[1], extent[2]);
+  return world;
+}
+
+ViewFrustum ViewFrustum::fromMatrix(const glm::mat4& m)
+{
+  // Each plane is the last row of the matrix plus or minus one of the others
+  // (Gribb and Hartmann), for GL's -w <= x, y, z <= w
+  ViewFrustum frustum;
+  for (int axis = 0; axis < 3; axis++)
+  {
+    for (int side = 0; side < 2; side++)
+    {
+      float sign = side == 0 ? 1.0f : -1.0f;
+      frustum.planes[axis * 2 + side] =
+        glm::vec4(m[0][3] + sign * m[0][axis], m[1][3] + sign * m[1][axis], m[2][3] + sign * m[2][axis],
+                  m[3][3] + sign * m[3][axis]);
+    }
+  }
+  return frustum;
+}
+
+void CullSet::Arrays::clear()
+{
+  cx.clear();
+  cy.clear();
+  cz.clear();
+  ex.clear();
+  ey.clear();
+  ez.clear();
+  index.clear();
+}
+
+void CullSet::Arrays::push(float x, float y, float z, float hx, float hy, float hz, uint32_t object)
+{
+  cx.push_back(x);
+  cy.push_back(y);
+  cz.push_back(z);
+  ex.push_back(hx);
+  ey.push_back(hy);
+  ez.push_back(hz);
+  index.push_back(object);
+}
+
+uint32_t CullSet::add(const BoundingBox& bounds)
+{
+  uint32_t index = (uint32_t)_objects.size();
+  _objects.push(bounds.center.x, bounds.center.y, bounds.center.z, bounds.extent.x, bounds.extent.y, bounds.extent.z,
+                index);
+  return index;
+}
+
+void CullSet::set(uint32_t index, const BoundingBox& bounds)
+{
+  _objects.cx[index] = bounds.center.x;
+  _objects.cy[index] = bounds.center.y;
+  _objects.cz[index] = bounds.center.z;
+  _objects.ex[index] = bounds.extent.x;
+  _objects.ey[index] = bounds.extent.y;
+  _objects.ez[index] = bounds.extent.z;
+}
+
+void CullSet::clear()
+{
+  _objects.clear();
+  _candidates.clear();
+}
+
+void CullSet::test(const Arrays& in, const ViewFrustum& first, const ViewFrustum* second, Arrays* out,
+                   std::vector<uint32_t>* visible, bool simd)
+{
+  PlaneTest tests[2][6];
+  planeTests(first, tests[0]);
+  if (second)
+  {
+    planeTests(*second, tests[1]);
+  }
+
+  auto keep = [&](size_t i)
+  {
+    if (out)
+    {
+      out->push(in.cx[i], in.cy[i], in.cz[i], in.ex[i], in.ey[i], in.ez[i], in.index[i]);
+    }
+    if (visible)
+    {
+      visible->push_back(in.index[i]);
+    }
+  };
+
+  size_t count = in.size(), i = 0;
+#ifdef CULL_SSE2
+  if (simd)
+  {
+    PlaneTest4 wide[2][6];
+    broadcast(tests[0], wide[0]);
+    if (second)
+    {
+      broadcast(tests[1], wide[1]);
+    }
+    for (; i + 4 <= count; i += 4)
+    {
+      __m128 cx = _mm_loadu_ps(&in.cx[i]), cy = _mm_loadu_ps(&in.cy[i]), cz = _mm_loadu_ps(&in.cz[i]);
+      __m128 ex = _mm_loadu_ps(&in.ex[i]), ey = _mm_loadu_ps(&in.ey[i]), ez = _mm_loadu_ps(&in.ez[i]);
+      __m128 culled = _mm_setzero_ps();
+      for (int p = 0; p < 6; p++)
+      {
+        __m128 out = outside4(wide[0][p], cx, cy, cz, ex, ey, ez);
+        if (second)
+        {
+          out = _mm_and_ps(out, outside4(wide[1][p], cx, cy, cz, ex, ey, ez));
+        }
+        culled = _mm_or_ps(culled, out);
+      }
+      int mask = _mm_movemask_ps(culled);
+      if (mask == 0xF)
+      {
+        continue;
+      }
+      for (int lane = 0; lane < 4; lane++)
+      {
+        if (!(mask & (1 << lane)))
+        {
+          keep(i + lane);
+        }
+      }
+    }
+  }
+#endif
+  // The scalar reference, and the last few objects of the SIMD path
+  for (; i < count; i++)
+  {
+    bool culled = false;
+    for (int p = 0; p < 6 && !culled; p++)
+    {
+      culled = outside(tests[0][p], in.cx[i], in.cy[i], in.cz[i], in.ex[i], in.ey[i], in.ez[i]) &&
+        (!second || outside(tests[1][p], in.cx[i], in.cy[i], in.cz[i], in.ex[i], in.ey[i], in.ez[i]));
+    }
+    if (!culled)
+    {
+      keep(i);
+    }
+  }
+}
+
+void CullSet::cull(const ViewFrustum* eyes, int eyeCount, std::vector<uint32_t>* visible, bool simd)
+{
+  for (int eye = 0; eye < eyeCount; eye++)
+  {
+    visible[eye].clear();
+  }
+  _candidates.clear();
+  if (eyeCount < 2)
+  {
+    test(_objects, eyes[0], nullptr, &_candidates, &visible[0], simd);
+    return;
+  }
+
+  // Whatever neither eye can see goes in one pass over everything...
+  test(_objects, eyes[0], &eyes[1], &_candidates, nullptr, simd);
+  // ...and only what is left is tested per eye
+  for (int eye = 0; eye < 2; eye++)
+  {
+    test(_candidates, eyes[eye], nullptr, nullptr, &visible[eye], simd);
+  }
+}
@@ -0,0 +1,79 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+// An axis-aligned box by its center and half extents
+struct BoundingBox
+{
+  glm::vec3 center;
+  glm::vec3 extent;
+
+  // The radius of the bounding sphere around the box
+  float radius() const;
+
+  // The box around 'local' moved by 'transform'
+  static BoundingBox transformed(const BoundingBox& local, const glm::mat4& transform);
+};
+
+// The six clip planes of a view-projection, as (a, b, c, d) with the inside
+// where a*x + b*y + c*z + d >= 0. The planes aren't normalized; the box test
+// doesn't need them to be.
+struct ViewFrustum
+{
+  glm::vec4 planes[6];
+
+  static ViewFrustum fromMatrix(const glm::mat4& viewProjection);
+};
+
+// The bounds of every cullable object, kept as structure of arrays so the
+// plane tests run on four objects per SSE instruction. Culling is two
+// stages: every object is tested once against both eyes together, then only
+// the survivors are tested for each eye.
+class CullSet
+{
+public:
+  // Returns the new object's index
+  uint32_t add(const BoundingBox& bounds);
+  void set(uint32_t index, const BoundingBox& bounds);
+  void clear();
+  size_t size() const { return _objects.size(); }
+
+  // Fills visible[eye] with the indices, in ascending order, of the objects
+  // that may be seen through eyes[eye], for 'eyeCount' (1 or 2) eyes. With
+  // two, an object is first dropped when some clip plane rejects it for both
+  // eyes (so neither can see it), and what is left is refined per eye. 'simd' selects the SSE tests over the scalar reference; both give
+  // the same lists.
+  void cull(const ViewFrustum* eyes, int eyeCount, std::vector<uint32_t>* visible, bool simd = true);
+
+  // How many objects passed the first stage of the last cull()
+  size_t candidates() const { return _candidates.size(); }
+
+private:
+  struct Arrays
+  {
+    std::vector<float> cx, cy, cz, ex, ey, ez;
+    std::vector<uint32_t> index;
+
+    size_t size() const { return index.size(); }
+    void clear();
+    void push(float x, float y, float z, float hx, float hy, float hz, uint32_t object);
+  };
+
+  // Appends to 'out' the entries of 'in' that no plane of 'first' rejects
+  // or, with a 'second' frustum, that no plane rejects for both
+  static void test(const Arrays& in, const ViewFrustum& first, const ViewFrustum* second, Arrays* out,
+                   std::vector<uint32_t>* visible, bool simd);
+
+  Arrays _objects, _candidates;
+};
+
+#endif
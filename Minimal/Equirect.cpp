@@ -0,0 +1,256 @@
+#include "Equirect.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "ThreadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define EQUIRECT_SSE2 1
+#endif
+
+namespace
+{
+  // Output rows per parallelFor item
+  const int bandRows = 16;
+
+  const float pi = 3.14159265358979f;
+
+  // The direction through a face texel is origin + s * axisS + t * axisT, with
+  // s and t in [-1, 1] across the face; the GL spec's cube map face table
+  struct FaceBasis
+  {
+    float origin[3];
+    float axisS[3];
+    float axisT[3];
+  };
+
+  const FaceBasis faceBases[6] = {
+    {{1, 0, 0}, {0, 0, -1}, {0, -1, 0}},  // +X
+    {{-1, 0, 0}, {0, 0, 1}, {0, -1, 0}},  // -X
+    {{0, 1, 0}, {1, 0, 0}, {0, 0, 1}},    // +Y
+    {{0, -1, 0}, {1, 0, 0}, {0, 0, -1}},  // -Y
+    {{0, 0, 1}, {1, 0, 0}, {0, -1, 0}},   // +Z
+    {{0, 0, -1}, {-1, 0, 0}, {0, -1, 0}}, // -Z
+  };
+
+  struct Source
+  {
+    const unsigned char* rgb;
+    int width;
+    int height;
+  };
+
+  // The texel coordinates (pixel centres at .5) a direction maps to
+  void project(const Source& src, float dx, float dy, float dz, float& px, float& py)
+  {
+    float lon = std::atan2(dx, -dz);
+    float lat = std::atan2(dy, std::sqrt(dx * dx + dz * dz));
+    px = (lon / (2.0f * pi) + 0.5f) * src.width - 0.5f;
+    py = (0.5f - lat / pi) * src.height - 0.5f;
+  }
+
+  void sampleScalar(const Source& src, float px, float py, unsigned char* dst)
+  {
+    int x0 = int(std::floor(px)), y0 = int(std::floor(py));
+    float fx = px - x0, fy = py - y0;
+    // Longitude wraps around the seam, latitude clamps at the poles
+    x0 = x0 < 0 ? x0 + src.width : x0;
+    int x1 = x0 + 1 == src.width ? 0 : x0 + 1;
+    int y1 = std::min(y0 + 1, src.height - 1);
+    y0 = std::max(y0, 0);
+
+    const unsigned char* r0 = src.rgb + size_t(y0) * src.width * 3;
+    const unsigned char* r1 = src.rgb + size_t(y1) * src.width * 3;
+    for (int c = 0; c < 3; c++)
+    {
+      float top = r0[x0 * 3 + c] + (r0[x1 * 3 + c] - r0[x0 * 3 + c]) * fx;
+      float bottom = r1[x0 * 3 + c] + (r1[x1 * 3 + c] - r1[x0 * 3 + c]) * fx;
+      dst[c] = (unsigned char)std::min(255.0f, top + (bottom - top) * fy + 0.5f);
+    }
+  }
+
+  void resampleRowScalar(const Source& src, const FaceBasis& basis, int size, float t, unsigned char* dst)
+  {
+    for (int x = 0; x < size; x++)
+    {
+      float s = (x + 0.5f) * 2.0f / size - 1.0f;
+      float d[3];
+      for (int c = 0; c < 3; c++)
+      {
+        d[c] = basis.origin[c] + s * basis.axisS[c] + t * basis.axisT[c];
+      }
+      float px, py;
+      project(src, d[0], d[1], d[2], px, py);
+      sampleScalar(src, px, py, dst + x * 3);
+    }
+  }
+
+#ifdef EQUIRECT_SSE2
+  // atan(x) for x in [0, 1]; Abramowitz & Stegun 4.4.49, within 1e-5 radians,
+  // which is well under a texel of any panorama we would load
+  __m128 atanUnit(__m128 x)
+  {
+    __m128 x2 = _mm_mul_ps(x, x);
+    __m128 p = _mm_set1_ps(0.0208351f);
+    p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-0.0851330f));
+    p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(0.1801410f));
+    p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-0.3302995f));
+    p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(0.9998660f));
+    return _mm_mul_ps(p, x);
+  }
+
+  __m128 select(__m128 mask, __m128 a, __m128 b)
+  {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+  }
+
+  __m128 atan2SIMD(__m128 y, __m128 x)
+  {
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    __m128 ax = _mm_andnot_ps(signBit, x), ay = _mm_andnot_ps(signBit, y);
+    __m128 hi = _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(1e-30f));
+    __m128 r = atanUnit(_mm_div_ps(_mm_min_ps(ax, ay), hi));
+    r = select(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(pi * 0.5f), r), r);
+    r = select(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(pi), r), r);
+    return _mm_or_ps(r, _mm_and_ps(y, signBit));
+  }
+
+  __m128 loadTexel(const unsigned char* p)
+  {
+    __m128i v = _mm_cvtsi32_si128(p[0] | (p[1] << 8) | (p[2] << 16));
+    v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, _mm_setzero_si128()), _mm_setzero_si128());
+    return _mm_cvtepi32_ps(v);
+  }
+
+  // Four output texels per iteration: directions, projection and the bilinear
+  // footprint are computed across lanes, then each lane blends its four RGB
+  // texels as one register
+  void resampleRowSIMD(const Source& src, const FaceBasis& basis, int size, float t, unsigned char* dst)
+  {
+    const __m128 step = _mm_set1_ps(2.0f / size);
+    const __m128 lanes = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    __m128 base[3], axis[3];
+    for (int c = 0; c < 3; c++)
+    {
+      base[c] = _mm_set1_ps(basis.origin[c] + t * basis.axisT[c] - basis.axisS[c]);
+      axis[c] = _mm_set1_ps(basis.axisS[c]);
+    }
+    const __m128 lonScale = _mm_set1_ps(src.width / (2.0f * pi)), lonOffset = _mm_set1_ps(src.width * 0.5f - 0.5f);
+    const __m128 latScale = _mm_set1_ps(-src.height / pi), latOffset = _mm_set1_ps(src.height * 0.5f - 0.5f);
+    const __m128i one = _mm_set1_epi32(1), zero = _mm_setzero_si128();
+    const __m128i width = _mm_set1_epi32(src.width), lastRow = _mm_set1_epi32(src.height - 1);
+    const __m128 half = _mm_set1_ps(0.5f), ceiling = _mm_set1_ps(255.0f);
+
+    int x = 0;
+    for (; x + 4 <= size; x += 4)
+    {
+      __m128 s = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(float(x)), lanes), step);
+      __m128 dx = _mm_add_ps(base[0], _mm_mul_ps(s, axis[0]));
+      __m128 dy = _mm_add_ps(base[1], _mm_mul_ps(s, axis[1]));
+      __m128 dz = _mm_add_ps(base[2], _mm_mul_ps(s, axis[2]));
+
+      __m128 lon = atan2SIMD(dx, _mm_sub_ps(_mm_setzero_ps(), dz));
+      __m128 lat = atan2SIMD(dy, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz))));
+      __m128 px = _mm_add_ps(_mm_mul_ps(lon, lonScale), lonOffset);
+      __m128 py = _mm_add_ps(_mm_mul_ps(lat, latScale), latOffset);
+
+      // Both are >= -0.5, so truncating after a +1 bias is a floor
+      __m128i x0 = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(px, _mm_set1_ps(1.0f))), one);
+      __m128i y0 = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(py, _mm_set1_ps(1.0f))), one);
+      __m128 fx = _mm_sub_ps(px, _mm_cvtepi32_ps(x0));
+      __m128 fy = _mm_sub_ps(py, _mm_cvtepi32_ps(y0));
+
+      x0 = _mm_add_epi32(x0, _mm_and_si128(_mm_cmplt_epi32(x0, zero), width));
+      __m128i x1 = _mm_add_epi32(x0, one);
+      x1 = _mm_andnot_si128(_mm_cmpeq_epi32(x1, width), x1);
+      __m128i y1 = _mm_add_epi32(y0, one);
+      y1 = _mm_sub_epi32(y1, _mm_and_si128(_mm_cmpgt_epi32(y1, lastRow), one));
+      y0 = _mm_andnot_si128(_mm_cmplt_epi32(y0, zero), y0);
+
+      alignas(16) int ix0[4], ix1[4], iy0[4], iy1[4];
+      alignas(16) float wx[4], wy[4];
+      _mm_store_si128(reinterpret_cast<__m128i*>(ix0), x0);
+      _mm_store_si128(reinterpret_cast<__m128i*>(ix1), x1);
+      _mm_store_si128(reinterpret_cast<__m128i*>(iy0), y0);
+      _mm_store_si128(reinterpret_cast<__m128i*>(iy1), y1);
+      _mm_store_ps(wx, fx);
+      _mm_store_ps(wy, fy);
+
+      for (int lane = 0; lane < 4; lane++)
+      {
+        const unsigned char* r0 = src.rgb + size_t(iy0[lane]) * src.width * 3;
+        const unsigned char* r1 = src.rgb + size_t(iy1[lane]) * src.width * 3;
+        __m128 p00 = loadTexel(r0 + ix0[lane] * 3), p01 = loadTexel(r0 + ix1[lane] * 3);
+        __m128 p10 = loadTexel(r1 + ix0[lane] * 3), p11 = loadTexel(r1 + ix1[lane] * 3);
+        __m128 fxl = _mm_set1_ps(wx[lane]), fyl = _mm_set1_ps(wy[lane]);
+        __m128 top = _mm_add_ps(p00, _mm_mul_ps(_mm_sub_ps(p01, p00), fxl));
+        __m128 bottom = _mm_add_ps(p10, _mm_mul_ps(_mm_sub_ps(p11, p10), fxl));
+        __m128 v = _mm_min_ps(_mm_add_ps(_mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fyl)), half), ceiling);
+        __m128i packed = _mm_cvttps_epi32(v);
+        packed = _mm_packus_epi16(_mm_packs_epi32(packed, packed), packed);
+        int rgbx = _mm_cvtsi128_si32(packed);
+        memcpy(dst + (x + lane) * 3, &rgbx, 3);
+      }
+    }
+
+    // The last few texels of a row that isn't a multiple of four
+    for (; x < size; x++)
+    {
+      float s = (x + 0.5f) * 2.0f / size - 1.0f;
+      float d[3];
+      for (int c = 0; c < 3; c++)
+      {
+        d[c] = basis.origin[c] + s * basis.axisS[c] + t * basis.axisT[c];
+      }
+      float px, py;
+      project(src, d[0], d[1], d[2], px, py);
+      sampleScalar(src, px, py, dst + x * 3);
+    }
+  }
+#endif
+}
+
+bool isEquirectangular(const std::string& path)
+{
+  static const std::string extension = ".ppm";
+  return path.size() > extension.size() &&
+    path.compare(path.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+int defaultFaceSize(int equirectWidth)
+{
+  return std::max(1, equirectWidth / 4);
+}
+
+void equirectToCubemap(const unsigned char* rgb, int width, int height, int faceSize,
+                       std::vector<unsigned char> faces[6], bool simd)
+{
+  Source src{rgb, width, height};
+  for (int face = 0; face < 6; face++)
+  {
+    faces[face].resize(size_t(faceSize) * faceSize * 3);
+  }
+
+  int bands = (faceSize + bandRows - 1) / bandRows;
+  parallelFor(size_t(6) * bands, [&](size_t item)
+  {
+    int face = int(item / bands);
+    int yBegin = int(item % bands) * bandRows, yEnd = std::min(yBegin + bandRows, faceSize);
+    const FaceBasis& basis = faceBases[face];
+    for (int y = yBegin; y < yEnd; y++)
+    {
+      float t = (y + 0.5f) * 2.0f / faceSize - 1.0f;
+      unsigned char* dst = faces[face].data() + size_t(y) * faceSize * 3;
+#ifdef EQUIRECT_SSE2
+      if (simd)
+      {
+        resampleRowSIMD(src, basis, faceSize, t, dst);
+        continue;
+      }
+#endif
+      resampleRowScalar(src, basis, faceSize, t, dst);
+    }
+  });
+}
@@ -0,0 +1,24 @@
+#ifndef EQUIRECT_H
+#define EQUIRECT_H
+
+#include <string>
+#include <vector>
+
+// True when 'path' names a single equirectangular image (a .ppm file) rather
+// than a directory of six faces
+bool isEquirectangular(const std::string& path);
+
+// The face size that keeps the panorama's sampling density at the equator:
+// each face spans 90 of the image's 360 degrees
+int defaultFaceSize(int equirectWidth);
+
+// Resamples a tightly packed RGB8 equirectangular panorama (longitude across,
+// latitude down, -Z at the centre) into six faceSize x faceSize RGB8 faces in
+// GL_TEXTURE_CUBE_MAP_POSITIVE_X + i order. Sampling is bilinear, wraps across
+// the left/right seam and clamps at the poles. Faces are split into bands of
+// rows spread over the worker pool; 'simd' selects the SSE2 resampler over the
+// scalar reference.
+void equirectToCubemap(const unsigned char* rgb, int width, int height, int faceSize,
+                       std::vector<unsigned char> faces[6], bool simd = true);
+
+#endif
@@ -0,0 +1,218 @@
+#include "GLState.h"
+
+namespace
+{
+  // No GL name or enum is this, so a shadow holding it never matches
+  const GLuint unknown = 0xFFFFFFFFu;
+
+  const GLenum capabilities[] = {GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_CLIP_DISTANCE0, GL_CLIP_DISTANCE1};
+  const GLenum textureTargets[] = {GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_ARRAY};
+}
+
+GLState::GLState()
+{
+  invalidate();
+}
+
+template <typename T> bool GLState::change(T& shadow, const T& value)
+{
+  if (shadow == value)
+  {
+    ++_frame.elided;
+    return false;
+  }
+  ++_frame.issued;
+  shadow = value;
+  return true;
+}
+
+int GLState::capabilityIndex(GLenum capability)
+{
+  for (int i = 0; i < CAPABILITIES; i++)
+  {
+    if (capabilities[i] == capability)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int GLState::targetIndex(GLenum target)
+{
+  for (int i = 0; i < TEXTURE_TARGETS; i++)
+  {
+    if (textureTargets[i] == target)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void GLState::useProgram(GLuint program)
+{
+  if (change(_program, program))
+  {
+    glUseProgram(program);
+  }
+}
+
+void GLState::bindVertexArray(GLuint vertexArray)
+{
+  if (change(_vertexArray, vertexArray))
+  {
+    glBindVertexArray(vertexArray);
+  }
+}
+
+void GLState::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+  int index = targetIndex(target);
+  if (unit >= TEXTURE_UNITS || index < 0)
+  {
+    // Not shadowed, and the active unit is no longer known
+    _frame.issued += 2;
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(target, texture);
+    _activeUnit = unknown;
+    return;
+  }
+  if (_textures[unit][index] == texture)
+  {
+    // Both the unit switch and the bind
+    _frame.elided += 2;
+    return;
+  }
+  if (change(_activeUnit, unit))
+  {
+    glActiveTexture(GL_TEXTURE0 + unit);
+  }
+  change(_textures[unit][index], texture);
+  glBindTexture(target, texture);
+}
+
+void GLState::setEnabled(GLenum capability, bool enabled)
+{
+  int index = capabilityIndex(capability);
+  if (index < 0)
+  {
+    ++_frame.issued;
+    enabled ? glEnable(capability) : glDisable(capability);
+    return;
+  }
+  if (change(_enabled[index], enabled ? 1 : 0))
+  {
+    enabled ? glEnable(capability) : glDisable(capability);
+  }
+}
+
+void GLState::cullFace(GLenum face)
+{
+  if (change(_cullFace, face))
+  {
+    glCullFace(face);
+  }
+}
+
+void GLState::depthMask(GLboolean mask)
+{
+  if (change(_depthMask, mask ? 1 : 0))
+  {
+    glDepthMask(mask);
+  }
+}
+
+void GLState::depthFunc(GLenum func)
+{
+  if (change(_depthFunc, func))
+  {
+    glDepthFunc(func);
+  }
+}
+
+void GLState::blendFunc(GLenum source, GLenum destination)
+{
+  if (_blendSource == source && _blendDestination == destination)
+  {
+    ++_frame.elided;
+    return;
+  }
+  ++_frame.issued;
+  _blendSource = source;
+  _blendDestination = destination;
+  glBlendFunc(source, destination);
+}
+
+void GLState::bindFramebuffer(GLenum target, GLuint framebuffer)
+{
+  bool draw = target != GL_READ_FRAMEBUFFER, read = target != GL_DRAW_FRAMEBUFFER;
+  if ((!draw || _drawFramebuffer == framebuffer) && (!read || _readFramebuffer == framebuffer))
+  {
+    ++_frame.elided;
+    return;
+  }
+  ++_frame.issued;
+  if (draw)
+  {
+    _drawFramebuffer = framebuffer;
+  }
+  if (read)
+  {
+    _readFramebuffer = framebuffer;
+  }
+  glBindFramebuffer(target, framebuffer);
+}
+
+void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+  if (_viewport[0] == x && _viewport[1] == y && _viewport[2] == width && _viewport[3] == height)
+  {
+    ++_frame.elided;
+    return;
+  }
+  ++_frame.issued;
+  _viewport[0] = x;
+  _viewport[1] = y;
+  _viewport[2] = width;
+  _viewport[3] = height;
+  glViewport(x, y, width, height);
+}
+
+void GLState::invalidate()
+{
+  _program = unknown;
+  _vertexArray = unknown;
+  _activeUnit = unknown;
+  for (auto& unit : _textures)
+  {
+    for (GLuint& texture : unit)
+    {
+      texture = unknown;
+    }
+  }
+  for (int& enabled : _enabled)
+  {
+    enabled = -1;
+  }
+  _cullFace = unknown;
+  _depthMask = -1;
+  _depthFunc = unknown;
+  _blendSource = _blendDestination = unknown;
+  _drawFramebuffer = _readFramebuffer = unknown;
+  // No viewport is negative
+  _viewport[0] = _viewport[1] = _viewport[2] = _viewport[3] = -1;
+}
+
+void GLState::beginFrame()
+{
+  _lastFrame = _frame;
+  _frame = Stats{0, 0};
+  invalidate();
+}
+
+GLState& GLState::shared()
+{
+  static GLState state;
+  return state;
+}
@@ -0,0 +1,81 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <GL/glew.h>
+
+// Shadows the GL state the draw paths change (program, vertex array, texture
+// units, depth/cull/blend/clip switches, framebuffers and viewport) and drops
+// calls that would set what is already set. It only knows what went through
+// it: anything else that touches this state (the texture loaders, oglplus, the
+// Oculus SDK) must be followed by invalidate(), which beginFrame() also does.
+// Only use it on the GL thread.
+class GLState
+{
+public:
+  static const unsigned int TEXTURE_UNITS = 8;
+
+  struct Stats
+  {
+    unsigned int issued;
+    unsigned int elided;
+  };
+
+  GLState();
+
+  GLState(const GLState&) = delete;
+  GLState& operator=(const GLState&) = delete;
+
+  void useProgram(GLuint program);
+  void bindVertexArray(GLuint vertexArray);
+  // Binds 'texture' to 'target' of 'unit', switching the active unit only when needed
+  void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+  // GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND and GL_CLIP_DISTANCE0-1
+  void setEnabled(GLenum capability, bool enabled);
+  void cullFace(GLenum face);
+  void depthMask(GLboolean mask);
+  void depthFunc(GLenum func);
+  void blendFunc(GLenum source, GLenum destination);
+
+  // GL_FRAMEBUFFER sets both the draw and the read binding
+  void bindFramebuffer(GLenum target, GLuint framebuffer);
+  void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+  // Forgets everything, so the next call of each kind goes to the driver
+  void invalidate();
+
+  // Starts counting a new frame (and invalidates, since the loaders and the
+  // SDK ran in between)
+  void beginFrame();
+  // Calls issued and elided during the last complete frame
+  Stats lastFrame() const { return _lastFrame; }
+
+  static GLState& shared();
+
+private:
+  // Counts the call and says whether it has to be issued
+  template <typename T> bool change(T& shadow, const T& value);
+
+  static int capabilityIndex(GLenum capability);
+  static int targetIndex(GLenum target);
+
+  static const int CAPABILITIES = 5;
+  static const int TEXTURE_TARGETS = 3;
+
+  GLuint _program;
+  GLuint _vertexArray;
+  GLuint _activeUnit;
+  GLuint _textures[TEXTURE_UNITS][TEXTURE_TARGETS];
+  int _enabled[CAPABILITIES]; // -1 when unknown
+  GLenum _cullFace;
+  int _depthMask;
+  GLenum _depthFunc;
+  GLenum _blendSource, _blendDestination;
+  GLuint _drawFramebuffer, _readFramebuffer;
+  GLint _viewport[4];
+
+  Stats _frame{0, 0};
+  Stats _lastFrame{0, 0};
+};
+
+#endif
@@ -0,0 +1,197 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace
+{
+  // Bar colors, cycled through in scope order
+  const float palette[][3] = {
+    {0.90f, 0.30f, 0.25f}, {0.25f, 0.70f, 0.30f}, {0.25f, 0.50f, 0.90f},
+    {0.95f, 0.75f, 0.20f}, {0.70f, 0.35f, 0.85f}, {0.20f, 0.80f, 0.80f},
+  };
+  const int paletteSize = sizeof(palette) / sizeof(palette[0]);
+
+  void fillRect(int x, int y, int width, int height, float r, float g, float b)
+  {
+    if (width <= 0 || height <= 0)
+    {
+      return;
+    }
+    glScissor(x, y, width, height);
+    glClearColor(r, g, b, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
+}
+
+GLuint GpuProfiler::query()
+{
+  Frame& frame = _frames[_current];
+  if (frame.used == frame.queries.size())
+  {
+    GLuint name = 0;
+    glGenQueries(1, &name);
+    frame.queries.push_back(name);
+  }
+  return frame.queries[frame.used++];
+}
+
+void GpuProfiler::collect(Frame& frame)
+{
+  if (frame.timings.empty())
+  {
+    return;
+  }
+  // Queries complete in the order they were issued, so the last one issued
+  // (the end of the outermost scope, not of the last scope begun) says
+  // whether all of them have
+  GLint available = 0;
+  glGetQueryObjectiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available)
+  {
+    ++_dropped;
+    return;
+  }
+
+  std::vector<double> totals(_names.size(), 0.0);
+  std::vector<bool> seen(_names.size(), false);
+  for (const Timing& timing : frame.timings)
+  {
+    GLuint64 begin = 0, end = 0;
+    glGetQueryObjectui64v(timing.begin, GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(timing.end, GL_QUERY_RESULT, &end);
+    totals[timing.scope] += double(end - begin) * 1e-6;
+    seen[timing.scope] = true;
+  }
+  for (size_t scope = 0; scope < totals.size(); scope++)
+  {
+    if (seen[scope])
+    {
+      Series& series = _series[scope];
+      series.samples[series.next] = totals[scope];
+      series.next = (series.next + 1) % HISTORY;
+      series.count = std::min(series.count + 1, HISTORY);
+    }
+  }
+}
+
+void GpuProfiler::beginFrame()
+{
+  _current = (_current + 1) % FRAME_DEPTH;
+  Frame& frame = _frames[_current];
+  collect(frame);
+  frame.used = 0;
+  frame.timings.clear();
+  _open.clear();
+  _inFrame = true;
+}
+
+void GpuProfiler::endFrame()
+{
+  while (!_open.empty())
+  {
+    end();
+  }
+  _inFrame = false;
+}
+
+void GpuProfiler::begin(const char* name)
+{
+  if (!_inFrame)
+  {
+    return;
+  }
+  auto found = _scopeIds.find(name);
+  if (found == _scopeIds.end())
+  {
+    found = _scopeIds.insert(std::make_pair(std::string(name), (unsigned int)_names.size())).first;
+    _names.push_back(name);
+    _series.push_back(Series());
+  }
+  Timing timing{found->second, query(), 0};
+  glQueryCounter(timing.begin, GL_TIMESTAMP);
+  _open.push_back(_frames[_current].timings.size());
+  _frames[_current].timings.push_back(timing);
+}
+
+void GpuProfiler::end()
+{
+  if (_open.empty())
+  {
+    return;
+  }
+  Timing& timing = _frames[_current].timings[_open.back()];
+  _open.pop_back();
+  timing.end = query();
+  glQueryCounter(timing.end, GL_TIMESTAMP);
+}
+
+std::vector<GpuProfiler::ScopeStats> GpuProfiler::stats() const
+{
+  std::vector<ScopeStats> result;
+  for (size_t scope = 0; scope < _names.size(); scope++)
+  {
+    const Series& series = _series[scope];
+    ScopeStats stats{_names[scope], 0.0, 0.0, 0.0, 0.0, series.count};
+    if (series.count)
+    {
+      stats.lastMs = series.samples[(series.next + HISTORY - 1) % HISTORY];
+      stats.minMs = stats.maxMs = stats.lastMs;
+      for (unsigned int i = 0; i < series.count; i++)
+      {
+        double sample = series.samples[i];
+        stats.meanMs += sample / series.count;
+        stats.minMs = std::min(stats.minMs, sample);
+        stats.maxMs = std::max(stats.maxMs, sample);
+      }
+    }
+    result.push_back(stats);
+  }
+  return result;
+}
+
+bool GpuProfiler::writeCSV(const std::string& path) const
+{
+  std::ofstream out(path);
+  if (!out)
+  {
+    return false;
+  }
+  out << "scope,last_ms,mean_ms,min_ms,max_ms,samples\n";
+  for (const ScopeStats& stats : this->stats())
+  {
+    out << stats.name << "," << stats.lastMs << "," << stats.meanMs << "," << stats.minMs << "," << stats.maxMs << ","
+        << stats.samples << "\n";
+  }
+  return bool(out);
+}
+
+void GpuProfiler::drawOverlay(int width, int height, double budgetMs) const
+{
+  const int margin = 8, barHeight = 8, spacing = 4;
+  double pixelsPerMs = budgetMs > 0.0 ? (width / 2) / budgetMs : 0.0;
+
+  GLfloat clearColor[4];
+  glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+  glEnable(GL_SCISSOR_TEST);
+
+  std::vector<ScopeStats> scopes = stats();
+  int y = margin;
+  for (size_t scope = 0; scope < scopes.size() && y + barHeight < height; scope++)
+  {
+    const float* color = palette[scope % paletteSize];
+    fillRect(margin, y, (int)(scopes[scope].meanMs * pixelsPerMs), barHeight, color[0], color[1], color[2]);
+    y += barHeight + spacing;
+  }
+  // The budget line, across every bar
+  fillRect(margin + (int)(budgetMs * pixelsPerMs), margin / 2, 2, y - margin / 2, 1.0f, 1.0f, 1.0f);
+
+  glDisable(GL_SCISSOR_TEST);
+  glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+}
+
+GpuProfiler& GpuProfiler::shared()
+{
+  static GpuProfiler* profiler = new GpuProfiler();
+  return *profiler;
+}
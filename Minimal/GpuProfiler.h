@@ -0,0 +1,110 @@
+#ifndef GPUPROFILER_H
+#define GPUPROFILER_H
+
+#include <GL/glew.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// Times named scopes of GPU work with GL_TIMESTAMP queries. Timestamps
+// (unlike GL_TIME_ELAPSED) nest, so a scope may open inside another. Each
+// frame's queries go into one slot of a ring FRAME_DEPTH frames deep, and a
+// slot is only read when the ring comes back round to it, by which time the
+// GPU has normally finished with it; if it hasn't, that frame's results are
+// dropped rather than waited for. A name used more than once in a frame (one
+// scope per eye, say) reports the sum. Only use it on the GL thread.
+class GpuProfiler
+{
+public:
+  static const unsigned int FRAME_DEPTH = 4;
+  // Frames the rolling statistics cover
+  static const unsigned int HISTORY = 120;
+
+  struct ScopeStats
+  {
+    std::string name;
+    double lastMs;
+    double meanMs;
+    double minMs;
+    double maxMs;
+    unsigned int samples;
+  };
+
+  GpuProfiler() {}
+
+  GpuProfiler(const GpuProfiler&) = delete;
+  GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+  // Frames bracket every scope. beginFrame() reads back the frame that last
+  // used the slot it moves to.
+  void beginFrame();
+  void endFrame();
+
+  void begin(const char* name);
+  // Closes the innermost open scope
+  void end();
+
+  // Rolling statistics of every scope seen so far, in order of first use
+  std::vector<ScopeStats> stats() const;
+  // Frames whose results weren't ready when their slot came round again
+  unsigned int dropped() const { return _dropped; }
+
+  // Writes stats() as CSV with a header line; false if 'path' can't be written
+  bool writeCSV(const std::string& path) const;
+
+  // Draws each scope's mean as a bar across the bottom left of the bound
+  // draw framebuffer ('width' x 'height'), scaled so 'budgetMs' (marked by a
+  // white line) spans half the width. Uses scissored clears only, so it
+  // needs no program and leaves no state behind but the scissor box.
+  void drawOverlay(int width, int height, double budgetMs) const;
+
+  // Like the CubeMesh, it lives as long as the process, so its queries are never deleted
+  static GpuProfiler& shared();
+
+private:
+  struct Timing
+  {
+    unsigned int scope;
+    GLuint begin, end;
+  };
+
+  struct Frame
+  {
+    std::vector<GLuint> queries;
+    size_t used{0};
+    std::vector<Timing> timings;
+  };
+
+  struct Series
+  {
+    double samples[HISTORY];
+    unsigned int count{0};
+    unsigned int next{0};
+  };
+
+  // The next unused query of the current frame, made on first need
+  GLuint query();
+  void collect(Frame& frame);
+
+  Frame _frames[FRAME_DEPTH];
+  unsigned int _current{0};
+  bool _inFrame{false};
+  std::vector<size_t> _open; // indices into the current frame's timings
+  std::map<std::string, unsigned int> _scopeIds;
+  std::vector<std::string> _names;
+  std::vector<Series> _series;
+  unsigned int _dropped{0};
+};
+
+// Times the GPU work issued during its lifetime as 'name'
+class GpuScope
+{
+public:
+  explicit GpuScope(const char* name) { GpuProfiler::shared().begin(name); }
+  ~GpuScope() { GpuProfiler::shared().end(); }
+
+  GpuScope(const GpuScope&) = delete;
+  GpuScope& operator=(const GpuScope&) = delete;
+};
+
+#endif
@@ -0,0 +1,193 @@
+#include "KTXFile.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include "AssetPack.h"
+
+namespace
+{
+  const unsigned char ktxIdentifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+  const uint32_t ktxEndianness = 0x04030201;
+
+  struct KTXHeader
+  {
+    unsigned char identifier[12];
+    uint32_t endianness;
+    uint32_t glType;
+    uint32_t glTypeSize;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+  };
+
+  size_t padTo4(size_t n)
+  {
+    return (n + 3) & ~size_t(3);
+  }
+}
+
+const char* describe(KTXError error)
+{
+  switch (error)
+  {
+  case KTXError::None:
+    return "no error";
+  case KTXError::NotFound:
+    return "could not open file";
+  case KTXError::BadIdentifier:
+    return "not a KTX 1.1 file";
+  case KTXError::Unsupported:
+    return "only little-endian cubemap KTX files are supported";
+  case KTXError::Truncated:
+    return "incomplete image data";
+  }
+  return "unknown error";
+}
+
+void KTXCubemap::prefetch() const
+{
+  if (!images.empty())
+  {
+    MappedFile::prefetch(images.front().data, images.back().data + images.back().bytes - images.front().data);
+  }
+}
+
+KTXError loadKTX(const std::string& filename, KTXCubemap& ktx)
+{
+  Asset asset;
+  if (!openAsset(filename, asset))
+  {
+    return KTXError::NotFound;
+  }
+
+  KTXHeader header;
+  if (asset.size < sizeof(header))
+  {
+    return KTXError::Truncated;
+  }
+  memcpy(&header, asset.data, sizeof(header));
+  if (memcmp(header.identifier, ktxIdentifier, sizeof(ktxIdentifier)) != 0)
+  {
+    return KTXError::BadIdentifier;
+  }
+  if (header.endianness != ktxEndianness || header.numberOfFaces != 6 || header.numberOfArrayElements != 0 ||
+      header.pixelDepth != 0 || header.pixelWidth != header.pixelHeight || header.pixelWidth == 0)
+  {
+    return KTXError::Unsupported;
+  }
+
+  const size_t end = asset.size;
+  size_t offset = sizeof(header) + header.bytesOfKeyValueData;
+  int levels = header.numberOfMipmapLevels ? int(header.numberOfMipmapLevels) : 1;
+  std::vector<KTXCubemap::Image> images;
+  for (int level = 0; level < levels; level++)
+  {
+    if (offset + 4 > end)
+    {
+      return KTXError::Truncated;
+    }
+    uint32_t imageSize;
+    memcpy(&imageSize, asset.data + offset, 4);
+    offset += 4;
+    for (int face = 0; face < 6; face++)
+    {
+      if (offset + imageSize > end)
+      {
+        return KTXError::Truncated;
+      }
+      images.push_back(KTXCubemap::Image{asset.data + offset, imageSize});
+      offset += padTo4(imageSize);
+    }
+  }
+
+  ktx.source = asset.file;
+  ktx.glInternalFormat = header.glInternalFormat;
+  ktx.glFormat = header.glFormat;
+  ktx.glType = header.glType;
+  ktx.size = int(header.pixelWidth);
+  ktx.levels = levels;
+  ktx.images = images;
+  return KTXError::None;
+}
+
+bool writeKTX(const std::string& filename, unsigned int glInternalFormat, unsigned int glBaseInternalFormat, int size,
+              int levels, const std::vector<std::vector<unsigned char>>& images, unsigned int glFormat,
+              unsigned int glType)
+{
+  std::ofstream out(filename, std::ios::binary);
+  if (!out.is_open())
+  {
+    return false;
+  }
+
+  KTXHeader header = {};
+  memcpy(header.identifier, ktxIdentifier, sizeof(ktxIdentifier));
+  header.endianness = ktxEndianness;
+  header.glType = glType;
+  header.glTypeSize = 1;
+  header.glFormat = glFormat;
+  header.glInternalFormat = glInternalFormat;
+  header.glBaseInternalFormat = glBaseInternalFormat;
+  header.pixelWidth = size;
+  header.pixelHeight = size;
+  header.numberOfFaces = 6;
+  header.numberOfMipmapLevels = levels;
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  const char padding[4] = {0, 0, 0, 0};
+  for (int level = 0; level < levels; level++)
+  {
+    int rows = std::max(1, size >> level);
+    size_t rowBytes = images[level * 6].size() / rows;
+    size_t paddedRow = glFormat ? padTo4(rowBytes) : rowBytes;
+    uint32_t imageSize = glFormat ? uint32_t(paddedRow * rows) : (uint32_t)images[level * 6].size();
+    out.write(reinterpret_cast<const char*>(&imageSize), 4);
+    for (int face = 0; face < 6; face++)
+    {
+      const std::vector<unsigned char>& image = images[level * 6 + face];
+      if (glFormat)
+      {
+        for (int row = 0; row < rows; row++)
+        {
+          out.write(reinterpret_cast<const char*>(image.data() + row * rowBytes), rowBytes);
+          out.write(padding, paddedRow - rowBytes);
+        }
+      }
+      else
+      {
+        out.write(reinterpret_cast<const char*>(image.data()), image.size());
+        out.write(padding, padTo4(image.size()) - image.size());
+      }
+    }
+  }
+  return out.good();
+}
+
+std::string ktxPathFor(const std::string& directory)
+{
+  std::string path = directory;
+  while (!path.empty() && (path.back() == '/' || path.back() == '\\'))
+  {
+    path.pop_back();
+  }
+  return path + ".ktx";
+}
+
+std::string residualPathFor(const std::string& directory)
+{
+  std::string path = directory;
+  while (!path.empty() && (path.back() == '/' || path.back() == '\\'))
+  {
+    path.pop_back();
+  }
+  return path + ".residual/";
+}
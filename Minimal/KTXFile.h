@@ -0,0 +1,66 @@
+#ifndef KTXFILE_H
+#define KTXFILE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+enum class KTXError
+{
+  None,
+  NotFound,
+  BadIdentifier,
+  Unsupported,
+  Truncated,
+};
+
+const char* describe(KTXError error);
+
+// A KTX 1.1 cubemap (six faces, one or more mip levels) read in place from a
+// file or asset pack mapping. Image pointers stay valid while 'source' is held.
+struct KTXCubemap
+{
+  struct Image
+  {
+    const unsigned char* data;
+    size_t bytes;
+  };
+
+  std::shared_ptr<MappedFile> source;
+  unsigned int glInternalFormat{0};
+  unsigned int glFormat{0}; // 0 for compressed formats
+  unsigned int glType{0};   // 0 for compressed formats
+  int size{0};
+  int levels{0};
+  // levels * 6 images, level-major, faces in GL_TEXTURE_CUBE_MAP_POSITIVE_X + i order
+  std::vector<Image> images;
+
+  bool compressed() const { return glFormat == 0; }
+  const Image& image(int level, int face) const { return images[level * 6 + face]; }
+  // Faults in the image data (and only that, when it lives inside a pack)
+  void prefetch() const;
+};
+
+KTXError loadKTX(const std::string& filename, KTXCubemap& ktx);
+
+// Writes a cubemap: block-compressed when glFormat is 0, otherwise tightly
+// packed pixels that are padded to the 4-byte rows KTX requires. 'images'
+// holds levels * 6 entries in the same level-major order as KTXCubemap::images.
+bool writeKTX(const std::string& filename, unsigned int glInternalFormat, unsigned int glBaseInternalFormat, int size,
+              int levels, const std::vector<std::vector<unsigned char>>& images, unsigned int glFormat = 0,
+              unsigned int glType = 0);
+
+// The container baked from a cubemap directory, e.g. "./skybox/" -> "./skybox.ktx"
+std::string ktxPathFor(const std::string& directory);
+
+// The pseudo-directory holding an eye's stereo residual, e.g.
+// "./skybox_righteye/" -> "./skybox_righteye.residual/", whose container is
+// ktxPathFor() of that: "./skybox_righteye.residual.ktx"
+std::string residualPathFor(const std::string& directory);
+
+// Residual texels hold (eye - base) / STEREO_RESIDUAL_SCALE + 128, so a full
+// -255..255 difference fits in eight bits at half the precision
+const float STEREO_RESIDUAL_SCALE = 2.0f;
+
+#endif
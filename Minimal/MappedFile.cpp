@@ -0,0 +1,148 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+}
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+void MappedFile::prefetch() const
+{
+  prefetch(_data, _size);
+}
+
+void MappedFile::prefetch(const unsigned char* data, size_t size)
+{
+  const size_t pageSize = 4096;
+  volatile unsigned char sink = 0;
+  for (size_t offset = 0; offset < size; offset += pageSize)
+  {
+    sink += data[offset];
+  }
+  (void)sink;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path)
+{
+  close();
+
+  // Faces are read front to back exactly once, so hint sequential access to the cache manager
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping == NULL)
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (view == NULL)
+  {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+
+  _file = file;
+  _mapping = mapping;
+  _data = static_cast<const unsigned char*>(view);
+  _size = static_cast<size_t>(size.QuadPart);
+  return true;
+}
+
+void MappedFile::close()
+{
+  if (_data)
+  {
+    UnmapViewOfFile(_data);
+  }
+  if (_mapping)
+  {
+    CloseHandle(_mapping);
+  }
+  if (_file)
+  {
+    CloseHandle(_file);
+  }
+  _data = nullptr;
+  _size = 0;
+  _mapping = nullptr;
+  _file = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path)
+{
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    ::close(fd);
+    return false;
+  }
+
+  void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  if (view == MAP_FAILED)
+  {
+    ::close(fd);
+    return false;
+  }
+  madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+  _fd = fd;
+  _data = static_cast<const unsigned char*>(view);
+  _size = static_cast<size_t>(st.st_size);
+  return true;
+}
+
+void MappedFile::close()
+{
+  if (_data)
+  {
+    munmap(const_cast<unsigned char*>(_data), _size);
+  }
+  if (_fd >= 0)
+  {
+    ::close(_fd);
+  }
+  _data = nullptr;
+  _size = 0;
+  _fd = -1;
+}
+
+#endif
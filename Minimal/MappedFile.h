@@ -0,0 +1,43 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+// A read-only view of a whole file mapped into the address space. Pages are
+// only faulted in when they are touched, so handing a pointer into the mapping
+// straight to the GL avoids the intermediate heap copy of a read().
+class MappedFile
+{
+public:
+  MappedFile();
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool open(const std::string& path);
+  void close();
+
+  bool isOpen() const { return _data != nullptr; }
+  const unsigned char* data() const { return _data; }
+  size_t size() const { return _size; }
+
+  // Touches every page so the disk reads happen on the calling thread rather
+  // than on whichever thread first dereferences the data
+  void prefetch() const;
+  // Same for one range of a mapping, e.g. a single asset inside a pack
+  static void prefetch(const unsigned char* data, size_t size);
+
+private:
+  const unsigned char* _data{nullptr};
+  size_t _size{0};
+#ifdef _WIN32
+  void* _file{nullptr};
+  void* _mapping{nullptr};
+#else
+  int _fd{-1};
+#endif
+};
+
+#endif
@@ -0,0 +1,208 @@
+#include "MipGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include "ThreadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_SSE2 1
+#endif
+
+namespace
+{
+  // Output rows per parallelFor item
+  const int bandRows = 16;
+
+  // Linear values are quantized to this many steps before re-encoding; fine
+  // enough that the steep low end of the sRGB curve still hits every code
+  const int encodeSteps = 16384;
+
+  // Maps 8-bit values to the linear floats the filter averages, and back
+  struct EncodingTables
+  {
+    float toLinear[256];
+    unsigned char fromLinear[encodeSteps];
+
+    explicit EncodingTables(bool srgb)
+    {
+      for (int i = 0; i < 256; i++)
+      {
+        float c = i / 255.0f;
+        toLinear[i] = !srgb ? c : c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+      }
+      for (int i = 0; i < encodeSteps; i++)
+      {
+        float l = i / float(encodeSteps - 1);
+        float s = !srgb ? l : l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+        fromLinear[i] = (unsigned char)std::min(255.0f, s * 255.0f + 0.5f);
+      }
+    }
+  };
+
+  const EncodingTables& tables(MipEncoding encoding)
+  {
+    static EncodingTables srgb(true), linear(false);
+    return encoding == MipEncoding::SRGB ? srgb : linear;
+  }
+
+  // Linear rows are RGBX floats so that one pixel is one SSE register
+  void decodeRow(const EncodingTables& tables, const unsigned char* src, int width, float* dst)
+  {
+    const float* toLinear = tables.toLinear;
+    for (int x = 0; x < width; x++)
+    {
+      dst[x * 4 + 0] = toLinear[src[x * 3 + 0]];
+      dst[x * 4 + 1] = toLinear[src[x * 3 + 1]];
+      dst[x * 4 + 2] = toLinear[src[x * 3 + 2]];
+      dst[x * 4 + 3] = 0.0f;
+    }
+  }
+
+  // The SIMD paths below sum in the same order, so both produce identical output
+  void filterPixel(const float* r0, const float* r1, int inWidth, int x, float* dst)
+  {
+    int x0 = x * 2, x1 = std::min(x * 2 + 1, inWidth - 1);
+    for (int c = 0; c < 4; c++)
+    {
+      dst[x * 4 + c] = ((r0[x0 * 4 + c] + r1[x0 * 4 + c]) + (r0[x1 * 4 + c] + r1[x1 * 4 + c])) * 0.25f;
+    }
+  }
+
+  void filterRowScalar(const float* r0, const float* r1, int inWidth, float* dst, int width)
+  {
+    for (int x = 0; x < width; x++)
+    {
+      filterPixel(r0, r1, inWidth, x, dst);
+    }
+  }
+
+  void filterRowSIMD(const float* r0, const float* r1, int inWidth, float* dst, int width)
+  {
+    int x = 0;
+#ifdef MIP_SSE2
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    for (; x < width && x * 2 + 1 < inWidth; x++)
+    {
+      __m128 s0 = _mm_add_ps(_mm_loadu_ps(r0 + x * 8), _mm_loadu_ps(r1 + x * 8));
+      __m128 s1 = _mm_add_ps(_mm_loadu_ps(r0 + x * 8 + 4), _mm_loadu_ps(r1 + x * 8 + 4));
+      _mm_storeu_ps(dst + x * 4, _mm_mul_ps(_mm_add_ps(s0, s1), quarter));
+    }
+#endif
+    // A 1-pixel-wide source (or no SIMD at all) falls through to the reference
+    for (; x < width; x++)
+    {
+      filterPixel(r0, r1, inWidth, x, dst);
+    }
+  }
+
+  void encodeRowScalar(const EncodingTables& tables, const float* src, int width, unsigned char* dst)
+  {
+    const unsigned char* fromLinear = tables.fromLinear;
+    for (int x = 0; x < width; x++)
+    {
+      for (int c = 0; c < 3; c++)
+      {
+        float v = std::min(std::max(src[x * 4 + c], 0.0f), 1.0f);
+        dst[x * 3 + c] = fromLinear[int(v * (encodeSteps - 1) + 0.5f)];
+      }
+    }
+  }
+
+  void encodeRowSIMD(const EncodingTables& tables, const float* src, int width, unsigned char* dst)
+  {
+#ifdef MIP_SSE2
+    const unsigned char* fromLinear = tables.fromLinear;
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(float(encodeSteps - 1)), half = _mm_set1_ps(0.5f);
+    for (int x = 0; x < width; x++)
+    {
+      __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + x * 4), zero), one);
+      __m128i index = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
+      int lanes[4];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), index);
+      dst[x * 3 + 0] = fromLinear[lanes[0]];
+      dst[x * 3 + 1] = fromLinear[lanes[1]];
+      dst[x * 3 + 2] = fromLinear[lanes[2]];
+    }
+#else
+    encodeRowScalar(tables, src, width, dst);
+#endif
+  }
+}
+
+int mipLevelCount(int width, int height)
+{
+  int levels = 1;
+  while (width > 1 || height > 1)
+  {
+    width = std::max(1, width / 2);
+    height = std::max(1, height / 2);
+    ++levels;
+  }
+  return levels;
+}
+
+std::vector<MipLevel> generateMips(const unsigned char* rgb, int width, int height, bool simd, MipEncoding encoding)
+{
+  const EncodingTables& table = tables(encoding);
+
+  int levels = mipLevelCount(width, height);
+  std::vector<MipLevel> mips(levels - 1);
+
+  // Level 1 reads the 8-bit source a row pair at a time; deeper levels read the
+  // previous level's linear floats, so nothing is re-quantized along the chain
+  std::vector<float> linear, next;
+  int inWidth = width, inHeight = height;
+  for (int level = 1; level < levels; level++)
+  {
+    MipLevel& mip = mips[level - 1];
+    mip.width = std::max(1, inWidth / 2);
+    mip.height = std::max(1, inHeight / 2);
+    mip.rgb.resize(size_t(mip.width) * mip.height * 3);
+    next.resize(size_t(mip.width) * mip.height * 4);
+
+    int bands = (mip.height + bandRows - 1) / bandRows;
+    parallelFor(bands, [&](size_t band)
+    {
+      std::vector<float> rows(level == 1 ? size_t(inWidth) * 8 : 0);
+      int end = std::min(mip.height, int(band + 1) * bandRows);
+      for (int y = int(band) * bandRows; y < end; y++)
+      {
+        int y0 = y * 2, y1 = std::min(y * 2 + 1, inHeight - 1);
+        const float* r0;
+        const float* r1;
+        if (level == 1)
+        {
+          decodeRow(table, rgb + size_t(y0) * inWidth * 3, inWidth, rows.data());
+          decodeRow(table, rgb + size_t(y1) * inWidth * 3, inWidth, rows.data() + size_t(inWidth) * 4);
+          r0 = rows.data();
+          r1 = rows.data() + size_t(inWidth) * 4;
+        }
+        else
+        {
+          r0 = linear.data() + size_t(y0) * inWidth * 4;
+          r1 = linear.data() + size_t(y1) * inWidth * 4;
+        }
+
+        float* dst = next.data() + size_t(y) * mip.width * 4;
+        unsigned char* out = mip.rgb.data() + size_t(y) * mip.width * 3;
+        if (simd)
+        {
+          filterRowSIMD(r0, r1, inWidth, dst, mip.width);
+          encodeRowSIMD(table, dst, mip.width, out);
+        }
+        else
+        {
+          filterRowScalar(r0, r1, inWidth, dst, mip.width);
+          encodeRowScalar(table, dst, mip.width, out);
+        }
+      }
+    });
+
+    linear.swap(next);
+    inWidth = mip.width;
+    inHeight = mip.height;
+  }
+  return mips;
+}
@@ -0,0 +1,32 @@
+#ifndef MIPGENERATOR_H
+#define MIPGENERATOR_H
+
+#include <vector>
+
+// How the 8-bit values are encoded. Colors are sRGB; data such as a stereo
+// residual is averaged as plain numbers.
+enum class MipEncoding
+{
+  SRGB,
+  Linear,
+};
+
+struct MipLevel
+{
+  int width;
+  int height;
+  std::vector<unsigned char> rgb;
+};
+
+// Number of levels in a full chain down to 1x1, including level 0
+int mipLevelCount(int width, int height);
+
+// Builds levels 1..N of a tightly packed RGB8 image (level 0 is the input
+// itself). Each level is a 2x2 box filter of the one above; sRGB input is
+// averaged in linear light and re-encoded, so dark/bright edges don't shift in
+// brightness as they minify. Rows of each level are spread over the worker
+// pool; 'simd' selects the SSE2 filter over the scalar reference.
+std::vector<MipLevel> generateMips(const unsigned char* rgb, int width, int height, bool simd = true,
+                                   MipEncoding encoding = MipEncoding::SRGB);
+
+#endif
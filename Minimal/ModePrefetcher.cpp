@@ -0,0 +1,63 @@
+#include "ModePrefetcher.h"
+
+#include <iostream>
+
+ModePrefetcher::ModePrefetcher(std::vector<std::vector<std::shared_ptr<Cubemap>>> modes) : _modes(std::move(modes))
+{
+}
+
+bool ModePrefetcher::complete(int mode) const
+{
+  for (const std::shared_ptr<Cubemap>& cubemap : _modes[mode])
+  {
+    if (!cubemap->owner().complete())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ModePrefetcher::update(int mode)
+{
+  if (mode < 0 || mode >= (int)_modes.size())
+  {
+    return;
+  }
+
+  if (mode != _mode)
+  {
+    bool ready = complete(mode);
+    bool predicted = mode == _warming;
+    ++_stats.switches;
+    _stats.readyInTime += ready;
+    _stats.prefetched += predicted;
+    std::cout << "Prefetch: mode " << _mode << " -> " << mode << (ready ? " ready" : " NOT ready");
+    if (predicted)
+    {
+      std::cout << " (warmed for " << _warmedFrames << " frames)";
+    }
+    std::cout << ", " << _stats.readyInTime << "/" << _stats.switches << " switches ready in time" << std::endl;
+
+    _mode = mode;
+    _stableFrames = 0;
+    _warming = -1;
+    _warmedFrames = 0;
+    return;
+  }
+
+  if (++_stableFrames >= STABLE_FRAMES)
+  {
+    _warming = (_mode + 1) % (int)_modes.size();
+    if (_warmedFrames >= WARM_FRAMES || complete(_warming))
+    {
+      // Warm; from here on it is only kept as long as the budget allows
+      return;
+    }
+    ++_warmedFrames;
+    for (const std::shared_ptr<Cubemap>& cubemap : _modes[_warming])
+    {
+      cubemap->owner().used = true;
+    }
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef MODEPREFETCHER_H
+#define MODEPREFETCHER_H
+
+#include <memory>
+#include <vector>
+#include "Cubemap.h"
+
+// Knows which cubemaps each viewing mode draws and that the X button steps
+// through the modes in order. Once the current mode has been stable for
+// STABLE_FRAMES, the next mode's cubemaps are warmed: marked as used every
+// frame, so the residency manager restores any it had reduced, until they are
+// all complete or WARM_FRAMES have passed. After that they are left to the
+// manager like anything else, rather than pinned at full residency for as
+// long as the mode lasts. Every mode switch is logged with whether everything
+// the new mode needs was already complete.
+class ModePrefetcher
+{
+public:
+  static const unsigned int STABLE_FRAMES = 45;
+  // The longest the next mode is marked for while it still isn't complete
+  static const unsigned int WARM_FRAMES = 300;
+
+  struct Stats
+  {
+    unsigned int switches;
+    unsigned int readyInTime; // everything the new mode draws was complete
+    unsigned int prefetched;  // the switch went to the mode being warmed
+  };
+
+  // modes[i] lists what mode i draws; the modes cycle 0, 1, ..., n - 1, 0
+  explicit ModePrefetcher(std::vector<std::vector<std::shared_ptr<Cubemap>>> modes);
+
+  // Call once per frame with the current mode, before the residency manager's update
+  void update(int mode);
+
+  const Stats& stats() const { return _stats; }
+
+private:
+  bool complete(int mode) const;
+
+  std::vector<std::vector<std::shared_ptr<Cubemap>>> _modes;
+  int _mode{0};
+  unsigned int _stableFrames{0};
+  int _warming{-1};
+  unsigned int _warmedFrames{0};
+  Stats _stats{0, 0, 0};
+};
+
+#endif
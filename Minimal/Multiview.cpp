@@ -0,0 +1,124 @@
+#include "Multiview.h"
+
+#include <string.h>
+#include <iostream>
+#include <GLFW/glfw3.h>
+#include "GLState.h"
+
+namespace
+{
+  // GL_OVR_multiview2 postdates the GLEW we ship with
+  typedef void(APIENTRY* FramebufferTextureMultiviewProc)(GLenum target, GLenum attachment, GLuint texture,
+                                                           GLint level, GLint baseViewIndex, GLsizei numViews);
+
+  FramebufferTextureMultiviewProc framebufferTextureMultiview = nullptr;
+
+  GLuint createLayers(GLenum internalFormat, GLenum format, GLenum type, int width, int height)
+  {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internalFormat, width, height, 2, 0, format, type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return texture;
+  }
+}
+
+bool multiviewSupported()
+{
+  static int supported = -1;
+  if (supported < 0)
+  {
+    supported = 0;
+    GLint extensionCount = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+    for (GLint i = 0; i < extensionCount; i++)
+    {
+      const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+      if (extension && strcmp(extension, "GL_OVR_multiview2") == 0)
+      {
+        framebufferTextureMultiview =
+          (FramebufferTextureMultiviewProc)glfwGetProcAddress("glFramebufferTextureMultiviewOVR");
+        supported = framebufferTextureMultiview ? 1 : 0;
+      }
+    }
+  }
+  return supported == 1;
+}
+
+MultiviewTarget::MultiviewTarget(int width, int height) : _width(width), _height(height)
+{
+  if (!multiviewSupported())
+  {
+    return;
+  }
+  // Matches the swap chain's sRGB format, so resolving is a plain copy
+  _color = createLayers(GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+  _depth = createLayers(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, width, height);
+
+  glGenFramebuffers(1, &_bothEyes);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _bothEyes);
+  framebufferTextureMultiview(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, _color, 0, 0, 2);
+  framebufferTextureMultiview(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, _depth, 0, 0, 2);
+  _valid = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+  glGenFramebuffers(2, _eyes);
+  for (int eye = 0; eye < 2; eye++)
+  {
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _eyes[eye]);
+    glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, _color, 0, eye);
+    glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, _depth, 0, eye);
+    _valid = _valid && glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  }
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+  if (!_valid)
+  {
+    std::cout << "The driver refused the multiview framebuffer" << std::endl;
+  }
+}
+
+MultiviewTarget::~MultiviewTarget()
+{
+  glDeleteFramebuffers(2, _eyes);
+  glDeleteFramebuffers(1, &_bothEyes);
+  glDeleteTextures(1, &_depth);
+  glDeleteTextures(1, &_color);
+}
+
+void MultiviewTarget::clear()
+{
+  // A clear through the multiview framebuffer reaches every view; it obeys
+  // the depth mask, which the skybox leaves off
+  bindBothEyes();
+  GLState::shared().depthMask(GL_TRUE);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void MultiviewTarget::bindBothEyes()
+{
+  GLState::shared().bindFramebuffer(GL_DRAW_FRAMEBUFFER, _bothEyes);
+  GLState::shared().viewport(0, 0, _width, _height);
+}
+
+void MultiviewTarget::bindEye(int eye)
+{
+  GLState::shared().bindFramebuffer(GL_DRAW_FRAMEBUFFER, _eyes[eye]);
+}
+
+void MultiviewTarget::resolve(GLuint target, const glm::vec4 viewports[2])
+{
+  GLState& state = GLState::shared();
+  state.bindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+  for (int eye = 0; eye < 2; eye++)
+  {
+    GLint x = (GLint)viewports[eye][0], y = (GLint)viewports[eye][1];
+    GLint width = (GLint)viewports[eye][2], height = (GLint)viewports[eye][3];
+    state.bindFramebuffer(GL_READ_FRAMEBUFFER, _eyes[eye]);
+    glBlitFramebuffer(0, 0, width, height, x, y, x + width, y + height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  }
+  state.bindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,52 @@
+#ifndef MULTIVIEW_H
+#define MULTIVIEW_H
+
+#include <GL/glew.h>
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/vec4.hpp>
+
+// True when the current context exposes GL_OVR_multiview2 (looked up once)
+bool multiviewSupported();
+
+// Both eyes as the two layers of a colour and a depth texture array. Draws go
+// either to both layers at once, through a GL_OVR_multiview2 framebuffer where
+// gl_ViewID_OVR picks the eye, or to one layer at a time for what differs per
+// eye. resolve() then copies the layers into the side-by-side swap chain
+// texture, which is what the compositor is given either way.
+class MultiviewTarget
+{
+public:
+  // Each layer is width x height; an eye may use less of it
+  MultiviewTarget(int width, int height);
+  ~MultiviewTarget();
+
+  MultiviewTarget(const MultiviewTarget&) = delete;
+  MultiviewTarget& operator=(const MultiviewTarget&) = delete;
+
+  // False when the driver refused the layered framebuffer
+  bool valid() const { return _valid; }
+
+  // Clears colour and depth of both layers
+  void clear();
+
+  // Binds the framebuffer whose draws reach both eyes; programs drawn into
+  // it must be built with MULTIVIEW
+  void bindBothEyes();
+  // Binds the framebuffer of one eye's layer
+  void bindEye(int eye);
+
+  // Copies each eye's layer into its viewport (x, y, width, height) of the
+  // draw framebuffer 'target'
+  void resolve(GLuint target, const glm::vec4 viewports[2]);
+
+private:
+  int _width, _height;
+  GLuint _color{0}, _depth{0};
+  GLuint _bothEyes{0};
+  GLuint _eyes[2]{0, 0};
+  bool _valid{false};
+};
+
+#endif
@@ -0,0 +1,143 @@
+#include "PPMImage.h"
+
+#include <cstdlib>
+#include "AssetPack.h"
+
+const char* describe(PPMError error)
+{
+  switch (error)
+  {
+  case PPMError::None:
+    return "no error";
+  case PPMError::NotFound:
+    return "could not open file";
+  case PPMError::BadMagic:
+    return "not a binary (P6) ppm file";
+  case PPMError::BadHeader:
+    return "malformed ppm header";
+  case PPMError::UnsupportedMaxval:
+    return "only 8-bit ppm files are supported";
+  case PPMError::Truncated:
+    return "incomplete pixel data";
+  }
+  return "unknown error";
+}
+
+namespace
+{
+  bool isSpace(unsigned char c)
+  {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+  }
+
+  // Skips whitespace and '#' comments between header tokens
+  void skipSeparators(const unsigned char* data, size_t size, size_t& pos)
+  {
+    while (pos < size)
+    {
+      if (isSpace(data[pos]))
+      {
+        ++pos;
+      }
+      else if (data[pos] == '#')
+      {
+        while (pos < size && data[pos] != '\n')
+        {
+          ++pos;
+        }
+      }
+      else
+      {
+        break;
+      }
+    }
+  }
+
+  bool readInt(const unsigned char* data, size_t size, size_t& pos, int& value)
+  {
+    skipSeparators(data, size, pos);
+    if (pos >= size || data[pos] < '0' || data[pos] > '9')
+    {
+      return false;
+    }
+    long long result = 0;
+    while (pos < size && data[pos] >= '0' && data[pos] <= '9')
+    {
+      result = result * 10 + (data[pos] - '0');
+      if (result > 65535)
+      {
+        return false;
+      }
+      ++pos;
+    }
+    value = static_cast<int>(result);
+    return true;
+  }
+}
+
+PPMError parsePPM(const unsigned char* data, size_t size, PPMImage& image)
+{
+  if (size < 2 || data[0] != 'P' || data[1] != '6')
+  {
+    return PPMError::BadMagic;
+  }
+
+  size_t pos = 2;
+  int width, height, maxval;
+  if (!readInt(data, size, pos, width) || !readInt(data, size, pos, height) || !readInt(data, size, pos, maxval))
+  {
+    return PPMError::BadHeader;
+  }
+  if (width <= 0 || height <= 0)
+  {
+    return PPMError::BadHeader;
+  }
+  if (maxval != 255)
+  {
+    return PPMError::UnsupportedMaxval;
+  }
+
+  // Exactly one whitespace character separates maxval from the raster
+  if (pos >= size || !isSpace(data[pos]))
+  {
+    return PPMError::BadHeader;
+  }
+  ++pos;
+
+  image.width = width;
+  image.height = height;
+  if (size - pos < image.byteSize())
+  {
+    image.width = 0;
+    image.height = 0;
+    return PPMError::Truncated;
+  }
+  image.pixels = data + pos;
+  return PPMError::None;
+}
+
+PPMError loadPPM(const std::string& filename, PPMImage& image)
+{
+  Asset asset;
+  if (!openAsset(filename, asset))
+  {
+    return PPMError::NotFound;
+  }
+
+  PPMError error = parsePPM(asset.data, asset.size, image);
+  if (error == PPMError::None)
+  {
+    image.source = asset.file;
+  }
+  return error;
+}
+
+PPMError decodePPM(const std::string& filename, PPMImage& image)
+{
+  PPMError error = loadPPM(filename, image);
+  if (error == PPMError::None)
+  {
+    MappedFile::prefetch(image.pixels, image.byteSize());
+  }
+  return error;
+}
@@ -0,0 +1,44 @@
+#ifndef PPMIMAGE_H
+#define PPMIMAGE_H
+
+#include <memory>
+#include <string>
+#include "MappedFile.h"
+
+enum class PPMError
+{
+  None,
+  NotFound,
+  BadMagic,
+  BadHeader,
+  UnsupportedMaxval,
+  Truncated,
+};
+
+const char* describe(PPMError error);
+
+// A binary (P6) PPM whose pixels are read in place from the mapped file (or pack).
+// 'pixels' stays valid for as long as the image holds on to 'source'.
+struct PPMImage
+{
+  std::shared_ptr<MappedFile> source;
+  const unsigned char* pixels{nullptr};
+  int width{0};
+  int height{0};
+
+  size_t byteSize() const { return size_t(width) * size_t(height) * 3; }
+};
+
+// Parses a P6 header that starts at 'data' and points 'image' at the pixel
+// payload that follows it. Only 8-bit (maxval 255) images are accepted.
+PPMError parsePPM(const unsigned char* data, size_t size, PPMImage& image);
+
+// Reads 'filename' out of the mounted asset pack when it is there, otherwise
+// maps the loose file
+PPMError loadPPM(const std::string& filename, PPMImage& image);
+
+// loadPPM followed by faulting in the pixels, so the disk reads are paid
+// by the calling (worker) thread instead of by the GL upload
+PPMError decodePPM(const std::string& filename, PPMImage& image);
+
+#endif
@@ -0,0 +1,166 @@
+#include "ProgramCache.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+  const char programMagic[8] = {'M', 'I', 'N', 'I', 'P', 'R', 'G', '\0'};
+
+  struct ProgramHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t binaryFormat;
+    uint64_t key;
+    uint64_t binaryBytes;
+  };
+
+  // FNV-1a; shader sources are a few KB, so this never shows up next to the driver
+  uint64_t hashString(uint64_t hash, const std::string& text)
+  {
+    for (unsigned char c : text)
+    {
+      hash = (hash ^ c) * 0x100000001b3ULL;
+    }
+    // Length-terminated, so moving text between two stages changes the key
+    uint64_t length = text.size();
+    for (int i = 0; i < 8; i++)
+    {
+      hash = (hash ^ ((length >> (i * 8)) & 0xff)) * 0x100000001b3ULL;
+    }
+    return hash;
+  }
+
+  std::string glString(GLenum name)
+  {
+    const GLubyte* value = glGetString(name);
+    return value ? reinterpret_cast<const char*>(value) : "";
+  }
+
+  bool makeDirectory(const std::string& path)
+  {
+#ifdef _WIN32
+    return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+  }
+}
+
+ProgramCache::ProgramCache(const std::string& directory) : _directory(directory)
+{
+}
+
+ProgramCache& ProgramCache::shared()
+{
+  static ProgramCache instance;
+  return instance;
+}
+
+std::string ProgramCache::pathFor(uint64_t key) const
+{
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+  return _directory + "/" + name;
+}
+
+uint64_t ProgramCache::key(const std::vector<std::string>& sources)
+{
+  // The driver strings only change between runs, so read them once
+  if (_driver.empty())
+  {
+    _driver = glString(GL_VENDOR) + "\n" + glString(GL_RENDERER) + "\n" + glString(GL_VERSION) + "\n" +
+      glString(GL_SHADING_LANGUAGE_VERSION);
+  }
+  uint64_t hash = hashString(0xcbf29ce484222325ULL, _driver);
+  for (const std::string& source : sources)
+  {
+    hash = hashString(hash, source);
+  }
+  return hash;
+}
+
+bool ProgramCache::load(GLuint program, uint64_t key)
+{
+  std::string path = pathFor(key);
+  std::ifstream in(path, std::ios::binary);
+  if (!in.is_open())
+  {
+    ++_stats.misses;
+    return false;
+  }
+
+  ProgramHeader header;
+  std::vector<char> binary;
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  bool valid = in.good() && memcmp(header.magic, programMagic, sizeof(programMagic)) == 0 &&
+    header.version == VERSION && header.key == key && header.binaryBytes > 0 && header.binaryBytes < (1u << 30);
+  if (valid)
+  {
+    binary.resize((size_t)header.binaryBytes);
+    in.read(binary.data(), binary.size());
+    valid = (size_t)in.gcount() == binary.size();
+  }
+  in.close();
+
+  GLint linked = GL_FALSE;
+  if (valid)
+  {
+    glProgramBinary(program, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  }
+  if (!linked)
+  {
+    // Truncated, or a driver that changed without changing its version string
+    std::cout << "Shader cache: discarding " << path << std::endl;
+    std::remove(path.c_str());
+    ++_stats.rejected;
+    return false;
+  }
+  ++_stats.hits;
+  return true;
+}
+
+bool ProgramCache::store(GLuint program, uint64_t key)
+{
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+  {
+    // The driver supports no binary formats
+    return false;
+  }
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  glGetProgramBinary(program, length, &length, &format, binary.data());
+
+  if (!_directoryReady)
+  {
+    _directoryReady = makeDirectory(_directory);
+  }
+  std::string path = pathFor(key);
+  std::ofstream out(path, std::ios::binary);
+  if (!out.is_open())
+  {
+    return false;
+  }
+  ProgramHeader header = {};
+  memcpy(header.magic, programMagic, sizeof(programMagic));
+  header.version = VERSION;
+  header.binaryFormat = format;
+  header.key = key;
+  header.binaryBytes = (uint64_t)length;
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(binary.data(), length);
+  return out.good();
+}
@@ -0,0 +1,61 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Keeps linked program binaries on disk between runs. A program is keyed by a
+// hash of its stage sources, exactly as handed to glShaderSource, plus the
+// driver's vendor, renderer and version strings, so a driver update or an
+// edited shader simply misses. On a hit glProgramBinary replaces compiling and
+// linking; a binary the driver rejects is deleted and the program is built
+// from source as usual. Layout of each <directory>/<key>.bin (little-endian):
+//
+//   header  "MINIPRG\0", uint32 version, uint32 binaryFormat, uint64 key, uint64 binaryBytes
+//   binary  binaryBytes of glGetProgramBinary output
+class ProgramCache
+{
+public:
+  static const unsigned int VERSION = 1;
+
+  struct Stats
+  {
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int rejected; // found on disk but refused by the driver
+  };
+
+  explicit ProgramCache(const std::string& directory = "shadercache");
+
+  ProgramCache(const ProgramCache&) = delete;
+  ProgramCache& operator=(const ProgramCache&) = delete;
+
+  // The key of a program linked from 'sources' (in stage order) on the
+  // current context's driver
+  uint64_t key(const std::vector<std::string>& sources);
+
+  // Loads the binary stored under 'key' into 'program'. True when the program
+  // is now linked; otherwise it is untouched and must be built from source.
+  bool load(GLuint program, uint64_t key);
+
+  // Writes the binary of 'program', which must have linked successfully. Set
+  // GL_PROGRAM_BINARY_RETRIEVABLE_HINT before linking it.
+  bool store(GLuint program, uint64_t key);
+
+  Stats stats() const { return _stats; }
+
+  // The cache the loaders use; only touch it on the GL thread
+  static ProgramCache& shared();
+
+private:
+  std::string pathFor(uint64_t key) const;
+
+  std::string _directory;
+  std::string _driver;
+  bool _directoryReady{false};
+  Stats _stats{0, 0, 0};
+};
+
+#endif
@@ -0,0 +1,146 @@
+#include "ProgramReflection.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+ProgramReflection::ProgramReflection(GLuint program) : _program(program)
+{
+  GLint count = 0, maxLength = 0;
+  glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+  std::vector<GLchar> name(std::max(maxLength, 1));
+  for (GLuint i = 0; i < GLuint(count); i++)
+  {
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(program, i, (GLsizei)name.size(), nullptr, &size, &type, name.data());
+    GLint blockIndex = -1, blockOffset = -1;
+    glGetActiveUniformsiv(program, 1, &i, GL_UNIFORM_BLOCK_INDEX, &blockIndex);
+    glGetActiveUniformsiv(program, 1, &i, GL_UNIFORM_OFFSET, &blockOffset);
+
+    // Arrays are reported as "name[0]"; they are looked up by their plain name
+    std::string key = name.data();
+    if (key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0)
+    {
+      key.resize(key.size() - 3);
+    }
+    GLint location = blockIndex < 0 ? glGetUniformLocation(program, name.data()) : -1;
+    _uniforms[key] = Uniform{location, type, size, blockIndex, blockOffset};
+  }
+
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+  name.resize(std::max(maxLength, 1));
+  for (GLuint i = 0; i < GLuint(count); i++)
+  {
+    glGetActiveUniformBlockName(program, i, (GLsizei)name.size(), nullptr, name.data());
+    Block block{i, 0, 0};
+    glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_DATA_SIZE, &block.dataSize);
+    glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_BINDING, &block.binding);
+    _blocks[name.data()] = block;
+  }
+
+  glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+  glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+  name.resize(std::max(maxLength, 1));
+  for (GLuint i = 0; i < GLuint(count); i++)
+  {
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveAttrib(program, i, (GLsizei)name.size(), nullptr, &size, &type, name.data());
+    _attributes[name.data()] = Attribute{glGetAttribLocation(program, name.data()), type};
+  }
+}
+
+const ProgramReflection::Uniform* ProgramReflection::findUniform(const std::string& name) const
+{
+  auto found = _uniforms.find(name);
+  return found != _uniforms.end() ? &found->second : nullptr;
+}
+
+const ProgramReflection::Block* ProgramReflection::findBlock(const std::string& name) const
+{
+  auto found = _blocks.find(name);
+  return found != _blocks.end() ? &found->second : nullptr;
+}
+
+const ProgramReflection::Attribute* ProgramReflection::findAttribute(const std::string& name) const
+{
+  auto found = _attributes.find(name);
+  return found != _attributes.end() ? &found->second : nullptr;
+}
+
+bool ProgramReflection::verify(const std::string& label, const ProgramInterface& expected) const
+{
+  unsigned int mismatches = 0;
+  for (const auto& expectedUniform : expected.uniforms)
+  {
+    const Uniform* uniform = findUniform(expectedUniform.first);
+    if (!uniform || uniform->type != expectedUniform.second || uniform->location < 0)
+    {
+      std::cout << label << ": expected uniform '" << expectedUniform.first << "' of GL type 0x" << std::hex
+        << expectedUniform.second;
+      if (uniform)
+      {
+        std::cout << ", found 0x" << uniform->type << (uniform->location < 0 ? " in a uniform block" : "");
+      }
+      else
+      {
+        std::cout << ", found none active";
+      }
+      std::cout << std::dec << std::endl;
+      ++mismatches;
+    }
+  }
+  for (const auto& expectedAttribute : expected.attributes)
+  {
+    const Attribute* attribute = findAttribute(expectedAttribute.first);
+    if (!attribute || attribute->location != expectedAttribute.second)
+    {
+      std::cout << label << ": expected attribute '" << expectedAttribute.first << "' at location "
+        << expectedAttribute.second << ", found " << (attribute ? "it at " + std::to_string(attribute->location) : "none active")
+        << std::endl;
+      ++mismatches;
+    }
+  }
+  for (const std::string& block : expected.blocks)
+  {
+    if (!findBlock(block))
+    {
+      std::cout << label << ": expected uniform block '" << block << "', found none active" << std::endl;
+      ++mismatches;
+    }
+  }
+  return mismatches == 0;
+}
+
+GLint ProgramReflection::resolve(const std::string& name, GLenum type) const
+{
+  const Uniform* uniform = findUniform(name);
+  if (!uniform)
+  {
+    // Not necessarily wrong: the compiler drops uniforms that don't affect the output
+    std::cout << "Program " << _program << " has no active uniform '" << name << "'" << std::endl;
+    return -1;
+  }
+  if (uniform->type != type || uniform->location < 0)
+  {
+    std::cout << "Program " << _program << ": uniform '" << name << "' is of GL type 0x" << std::hex << uniform->type
+      << ", but the C++ side sets 0x" << type << std::dec << (uniform->location < 0 ? " in a uniform block" : "")
+      << std::endl;
+    return -1;
+  }
+  return uniform->location;
+}
+
+const ProgramReflection& ProgramReflection::of(GLuint program)
+{
+  static std::map<GLuint, std::unique_ptr<ProgramReflection>> reflections;
+  std::unique_ptr<ProgramReflection>& reflection = reflections[program];
+  if (!reflection)
+  {
+    reflection.reset(new ProgramReflection(program));
+  }
+  return *reflection;
+}
@@ -0,0 +1,136 @@
+#ifndef PROGRAMREFLECTION_H
+#define PROGRAMREFLECTION_H
+
+#include <GL/glew.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+// A uniform whose location was resolved once, up front. A handle to a uniform
+// the program doesn't have (or has with another type) holds -1, which the GL
+// silently ignores, so setting it is always safe.
+template <typename T>
+struct UniformHandle
+{
+  GLint location{-1};
+
+  UniformHandle() {}
+  explicit UniformHandle(GLint location) : location(location) {}
+
+  void set(const T& value) const;
+  explicit operator bool() const { return location >= 0; }
+};
+
+template <> inline void UniformHandle<glm::mat4>::set(const glm::mat4& value) const
+{
+  glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]);
+}
+
+template <> inline void UniformHandle<glm::vec4>::set(const glm::vec4& value) const
+{
+  glUniform4fv(location, 1, &value[0]);
+}
+
+template <> inline void UniformHandle<float>::set(const float& value) const
+{
+  glUniform1f(location, value);
+}
+
+// Samplers and ints are both set as a single int
+template <> inline void UniformHandle<GLint>::set(const GLint& value) const
+{
+  glUniform1i(location, value);
+}
+
+// What the C++ side expects of a program: the uniforms it sets (by GLSL type),
+// the attributes it feeds (by location) and the uniform blocks it binds
+struct ProgramInterface
+{
+  std::vector<std::pair<std::string, GLenum>> uniforms;
+  std::vector<std::pair<std::string, GLint>> attributes;
+  std::vector<std::string> blocks;
+};
+
+// Everything a linked program exposes through its attributes, its default
+// uniform block and its named uniform blocks, read once with glGetActiveUniform
+// and friends. The C++ side asks for typed handles by name, and verify() checks
+// a whole ProgramInterface as soon as the program has linked, so a drifting
+// shader interface shows up at load time instead of as a silently missing
+// uniform.
+class ProgramReflection
+{
+public:
+  struct Uniform
+  {
+    GLint location; // -1 inside a uniform block
+    GLenum type;
+    GLint arraySize;
+    GLint blockIndex; // -1 in the default block
+    GLint blockOffset;
+  };
+
+  struct Block
+  {
+    GLuint index;
+    GLint dataSize;
+    GLint binding;
+  };
+
+  struct Attribute
+  {
+    GLint location;
+    GLenum type;
+  };
+
+  explicit ProgramReflection(GLuint program);
+
+  ProgramReflection(const ProgramReflection&) = delete;
+  ProgramReflection& operator=(const ProgramReflection&) = delete;
+
+  GLuint program() const { return _program; }
+  const Uniform* findUniform(const std::string& name) const;
+  const Block* findBlock(const std::string& name) const;
+  const Attribute* findAttribute(const std::string& name) const;
+
+  // Typed handles, each checked against the uniform's GLSL type; a sampler
+  // handle must name a uniform of 'samplerType'.
+  UniformHandle<glm::mat4> mat4(const std::string& name) const
+  {
+    return UniformHandle<glm::mat4>(resolve(name, GL_FLOAT_MAT4));
+  }
+  UniformHandle<glm::vec4> vec4(const std::string& name) const
+  {
+    return UniformHandle<glm::vec4>(resolve(name, GL_FLOAT_VEC4));
+  }
+  UniformHandle<float> scalar(const std::string& name) const { return UniformHandle<float>(resolve(name, GL_FLOAT)); }
+  UniformHandle<GLint> sampler(const std::string& name, GLenum samplerType) const
+  {
+    return UniformHandle<GLint>(resolve(name, samplerType));
+  }
+
+  // Reports every part of 'expected' the program lacks or has otherwise
+  // ('label' names the program); true when all of it matched
+  bool verify(const std::string& label, const ProgramInterface& expected) const;
+
+  // The reflection of a linked program, built on first request and kept for
+  // the life of the process (our programs are never deleted and their names
+  // never reused). Only touch it on the GL thread.
+  static const ProgramReflection& of(GLuint program);
+
+private:
+  GLint resolve(const std::string& name, GLenum type) const;
+
+  GLuint _program;
+  std::map<std::string, Uniform> _uniforms;
+  std::map<std::string, Block> _blocks;
+  std::map<std::string, Attribute> _attributes;
+};
+
+#endif
@@ -0,0 +1,224 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "GLState.h"
+#include "GpuProfiler.h"
+
+namespace
+{
+  // Depths are spread over this many metres; anything further sorts as the far end
+  const float depthRange = 64.0f;
+
+  // Field widths of the key. GL names are small integers handed out in
+  // order, so their low bits tell them apart; a collision only costs grouping.
+  const int layerBits = 2, programBits = 12, vertexArrayBits = 12, textureBits = 16, depthBits = 16;
+
+  uint64_t field(uint64_t value, int bits)
+  {
+    return value & ((uint64_t(1) << bits) - 1);
+  }
+
+  uint64_t quantizeDepth(float depth)
+  {
+    float unit = std::min(std::max(depth / depthRange, 0.0f), 1.0f);
+    return (uint64_t)(unit * float((1 << depthBits) - 1));
+  }
+
+  // The GPU scope each layer is timed as
+  const char* layerName(DrawPacket::Layer layer)
+  {
+    switch (layer)
+    {
+    case DrawPacket::Opaque:
+      return "opaque";
+    case DrawPacket::Background:
+      return "background";
+    default:
+      return "translucent";
+    }
+  }
+
+  // How many of the states 'next' binds differ from what 'previous' left
+  unsigned int stateChanges(const DrawPacket* previous, const DrawPacket& next)
+  {
+    if (!previous)
+    {
+      return 5 + (next.textures[0] ? 1 : 0) + (next.textures[1] ? 1 : 0);
+    }
+    unsigned int changes = 0;
+    changes += previous->program != next.program;
+    changes += previous->vertexArray != next.vertexArray;
+    changes += next.textures[0] && previous->textures[0] != next.textures[0];
+    changes += next.textures[1] && previous->textures[1] != next.textures[1];
+    changes += previous->cullFace != next.cullFace;
+    changes += previous->depthWrite != next.depthWrite;
+    changes += previous->depthFunc != next.depthFunc;
+    return changes;
+  }
+}
+
+uint64_t RenderQueue::key(const DrawPacket& packet, float depth)
+{
+  uint64_t layer = field(packet.layer, layerBits);
+  uint64_t state = field(packet.program, programBits);
+  state = (state << vertexArrayBits) | field(packet.vertexArray, vertexArrayBits);
+  state = (state << textureBits) | field(packet.textures[0], textureBits);
+  uint64_t nearFirst = quantizeDepth(depth);
+
+  const int stateBits = programBits + vertexArrayBits + textureBits;
+  const int top = 64 - layerBits;
+  if (packet.layer == DrawPacket::Translucent)
+  {
+    // Blending needs back to front, so depth outranks state
+    uint64_t farFirst = field(~nearFirst, depthBits);
+    return (layer << top) | (farFirst << (top - depthBits)) | (state << (top - depthBits - stateBits));
+  }
+  // Opaque: group by state, then front to back within a group for early depth rejection
+  return (layer << top) | (state << (top - stateBits)) | nearFirst;
+}
+
+void RenderQueue::beginFrame()
+{
+  _lastFrame = _frame;
+  _frame = Stats{0, 0, 0, 0, 0.0};
+  _packets.clear();
+  _order.clear();
+}
+
+void RenderQueue::submit(const DrawPacket& packet)
+{
+  _packets.push_back(packet);
+  ++_frame.packets;
+}
+
+void RenderQueue::sort(const glm::vec3& viewpoint)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  _order.resize(_packets.size());
+  for (size_t i = 0; i < _packets.size(); i++)
+  {
+    const DrawPacket& packet = _packets[i];
+    glm::vec3 offset = packet.rotationOnly ? glm::vec3(0.0f) : packet.position - viewpoint;
+    float depth = std::sqrt(offset.x * offset.x + offset.y * offset.y + offset.z * offset.z);
+    _order[i] = Entry{key(packet, depth), (uint32_t)i};
+  }
+  radixSort();
+  auto end = std::chrono::high_resolution_clock::now();
+  _frame.sortMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void RenderQueue::radixSort()
+{
+  const int passes = 8;
+  size_t count = _order.size();
+  if (count < 2)
+  {
+    return;
+  }
+
+  // Every pass's histogram in one sweep
+  size_t histograms[passes][256] = {};
+  for (const Entry& entry : _order)
+  {
+    for (int pass = 0; pass < passes; pass++)
+    {
+      ++histograms[pass][(entry.key >> (8 * pass)) & 0xFF];
+    }
+  }
+
+  _scratch.resize(count);
+  for (int pass = 0; pass < passes; pass++)
+  {
+    size_t* histogram = histograms[pass];
+    int shift = 8 * pass;
+    // A byte every key shares (the unused and the high bits, mostly) leaves the order as it is
+    if (histogram[(_order[0].key >> shift) & 0xFF] == count)
+    {
+      continue;
+    }
+    size_t offset = 0;
+    for (int digit = 0; digit < 256; digit++)
+    {
+      size_t n = histogram[digit];
+      histogram[digit] = offset;
+      offset += n;
+    }
+    for (const Entry& entry : _order)
+    {
+      _scratch[histogram[(entry.key >> shift) & 0xFF]++] = entry;
+    }
+    _order.swap(_scratch);
+  }
+}
+
+void RenderQueue::replay(const glm::mat4& projection, const glm::mat4& view, int eye,
+                         const std::vector<uint32_t>* visible)
+{
+  if (visible)
+  {
+    _visible.assign(visible->empty() ? 0 : visible->back() + 1, 0);
+    for (uint32_t index : *visible)
+    {
+      _visible[index] = 1;
+    }
+  }
+
+  GLState& state = GLState::shared();
+  glm::mat4 rotation = glm::mat4(glm::mat3(view));
+  unsigned int eyeBit = 1u << eye;
+  const DrawPacket* previous = nullptr;
+  // Packets come sorted by layer, so each layer is one GPU scope
+  GpuProfiler& gpu = GpuProfiler::shared();
+  int openLayer = -1;
+  for (const Entry& entry : _order)
+  {
+    const DrawPacket& packet = _packets[entry.packet];
+    if (!(packet.eyes & eyeBit))
+    {
+      continue;
+    }
+    if (visible && packet.cullIndex != DrawPacket::NOT_CULLED &&
+        (packet.cullIndex >= _visible.size() || !_visible[packet.cullIndex]))
+    {
+      ++_frame.culled;
+      continue;
+    }
+    _frame.stateChanges += stateChanges(previous, packet);
+    previous = &packet;
+    if (packet.layer != openLayer)
+    {
+      if (openLayer >= 0)
+      {
+        gpu.end();
+      }
+      openLayer = packet.layer;
+      gpu.begin(layerName(packet.layer));
+    }
+
+    state.useProgram(packet.program);
+    state.bindVertexArray(packet.vertexArray);
+    for (GLuint unit = 0; unit < 2; unit++)
+    {
+      if (packet.textures[unit])
+      {
+        state.bindTexture(unit, GL_TEXTURE_CUBE_MAP, packet.textures[unit]);
+      }
+    }
+    state.setEnabled(GL_CULL_FACE, packet.cullFace != 0);
+    if (packet.cullFace)
+    {
+      state.cullFace(packet.cullFace);
+    }
+    state.depthMask(packet.depthWrite);
+    state.depthFunc(packet.depthFunc);
+
+    packet.draw(packet, projection, packet.rotationOnly ? rotation : view);
+    ++_frame.draws;
+  }
+  if (openLayer >= 0)
+  {
+    gpu.end();
+  }
+}
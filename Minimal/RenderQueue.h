@@ -0,0 +1,127 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+struct DrawPacket;
+
+// Issues what a packet adds to the state the queue bound for it: its own
+// uniforms and the draw call. 'view' is the eye's camera, already stripped of
+// its translation for packets that asked for that.
+typedef void (*DrawFunction)(const DrawPacket& packet, const glm::mat4& projection, const glm::mat4& view);
+
+// One draw, as the scene submits it to a RenderQueue
+struct DrawPacket
+{
+  // Opaque draws go first, front to back; the background fills in what they
+  // left uncovered, and translucent draws go last, back to front
+  enum Layer
+  {
+    Opaque = 0,
+    Background = 1,
+    Translucent = 2,
+  };
+
+  // Which eyes a packet is drawn for
+  static const unsigned int LEFT_EYE = 1;
+  static const unsigned int RIGHT_EYE = 2;
+  static const unsigned int BOTH_EYES = LEFT_EYE | RIGHT_EYE;
+
+  Layer layer{Opaque};
+  unsigned int eyes{BOTH_EYES};
+  GLuint program{0};
+  GLuint vertexArray{0};
+  // Cube maps on texture units 0 and 1; 0 leaves a unit as it is
+  GLuint textures[2]{0, 0};
+  // 0 draws both sides
+  GLenum cullFace{0};
+  GLboolean depthWrite{GL_TRUE};
+  GLenum depthFunc{GL_LESS};
+  // Drawn with the eye's rotation only, as if the eye sat at the origin
+  bool rotationOnly{false};
+  // World-space point the depth order is taken from
+  glm::vec3 position;
+  // The packet's bounds in the CullSet whose visible lists are replayed with,
+  // or NOT_CULLED for a packet that is always drawn
+  static const uint32_t NOT_CULLED = 0xFFFFFFFFu;
+  uint32_t cullIndex{NOT_CULLED};
+
+  DrawFunction draw{nullptr};
+  void* object{nullptr};
+};
+
+// The scene's draws for one frame. Packets are submitted once, sorted once by
+// a 64-bit key (layer, then program, vertex array and texture so neighbours
+// share state, then depth), and the sorted list is replayed for each eye with
+// only the camera changed. State goes through GLState, so what a packet shares
+// with the one before it is not set again.
+class RenderQueue
+{
+public:
+  struct Stats
+  {
+    unsigned int packets;
+    unsigned int draws;
+    // Packets skipped because their bounds weren't visible
+    unsigned int culled;
+    // Program, vertex array, texture and rasterizer switches between the
+    // packets as replayed, the first packet of each replay counting in full
+    unsigned int stateChanges;
+    double sortMilliseconds;
+  };
+
+  RenderQueue() {}
+
+  RenderQueue(const RenderQueue&) = delete;
+  RenderQueue& operator=(const RenderQueue&) = delete;
+
+  // Empties the queue (keeping its storage) and starts counting a new frame
+  void beginFrame();
+
+  void submit(const DrawPacket& packet);
+
+  // Keys every packet, with depths measured from 'viewpoint', and sorts them
+  void sort(const glm::vec3& viewpoint);
+
+  // Draws, in sorted order, the packets 'eye' (0 or 1) takes. With a
+  // 'visible' list (ascending CullSet indices), packets with bounds are only
+  // drawn when their cullIndex is in it.
+  void replay(const glm::mat4& projection, const glm::mat4& view, int eye,
+              const std::vector<uint32_t>* visible = nullptr);
+
+  size_t size() const { return _packets.size(); }
+
+  // Counts for the last complete frame
+  Stats lastFrame() const { return _lastFrame; }
+
+  // The sort key of 'packet' at 'depth' metres from the viewpoint
+  static uint64_t key(const DrawPacket& packet, float depth);
+
+private:
+  struct Entry
+  {
+    uint64_t key;
+    uint32_t packet;
+  };
+
+  // Stable LSD radix sort of _order by key, a byte per pass
+  void radixSort();
+
+  std::vector<DrawPacket> _packets;
+  std::vector<Entry> _order, _scratch;
+  // The replayed visible list as one flag per CullSet index
+  std::vector<unsigned char> _visible;
+
+  Stats _frame{0, 0, 0, 0, 0.0};
+  Stats _lastFrame{0, 0, 0, 0, 0.0};
+};
+
+#endif
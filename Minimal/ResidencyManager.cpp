@@ -0,0 +1,125 @@
+#include "ResidencyManager.h"
+
+#include <algorithm>
+#include <iostream>
+
+ResidencyManager::ResidencyManager(TextureCache& cache, size_t budgetBytes) : _cache(cache)
+{
+  _stats = Stats{0, budgetBytes, 0, 0, 0};
+}
+
+void ResidencyManager::report(const char* action, const Cubemap& cubemap) const
+{
+  std::cout << "Residency: " << action << " " << cubemap.source << " (" << _stats.residentBytes / (1024 * 1024)
+    << " of " << _stats.budgetBytes / (1024 * 1024) << " MB)" << std::endl;
+}
+
+bool ResidencyManager::downgrade(const std::shared_ptr<Cubemap>& cubemap)
+{
+  const CubemapStorage& from = cubemap->resident;
+  if (from.levels <= 1)
+  {
+    return false;
+  }
+
+  if (GLEW_ARB_copy_image && GLEW_ARB_texture_storage)
+  {
+    // Every level but the top one is already on the GPU; copy them into a
+    // texture that leaves it out
+    CubemapStorage to;
+    to.internalFormat = from.internalFormat;
+    to.size = std::max(1, from.size / 2);
+    to.levels = from.levels - 1;
+    to.baseLevel = from.baseLevel + 1;
+    glGenTextures(1, &to.texture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, to.texture);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, to.levels, to.internalFormat, to.size, to.size);
+    setCubemapParameters(to.levels);
+    for (int level = 0; level < to.levels; level++)
+    {
+      int levelSize = std::max(1, to.size >> level);
+      glCopyImageSubData(from.texture, GL_TEXTURE_CUBE_MAP, level + 1, 0, 0, 0,
+                         to.texture, GL_TEXTURE_CUBE_MAP, level, 0, 0, 0, levelSize, levelSize, 6);
+    }
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    cubemap->incoming = to;
+    cubemap->promote();
+  }
+  else
+  {
+    // Without image copies, re-stream the smaller chain from the source
+    _cache.streamer().load(cubemap->source, cubemap, from.baseLevel + 1);
+  }
+  cubemap->reduced = true;
+  ++_stats.downgrades;
+  return true;
+}
+
+void ResidencyManager::evict(const std::shared_ptr<Cubemap>& cubemap)
+{
+  cubemap->evict();
+  cubemap->reduced = true;
+  ++_stats.evictions;
+}
+
+void ResidencyManager::update()
+{
+  ++_frame;
+
+  std::vector<std::shared_ptr<Cubemap>> cubemaps = _cache.entries();
+  size_t total = 0;
+  for (const std::shared_ptr<Cubemap>& cubemap : cubemaps)
+  {
+    if (cubemap->used)
+    {
+      cubemap->used = false;
+      cubemap->lastUsedFrame = _frame;
+      if (cubemap->reduced && !cubemap->streaming())
+      {
+        _cache.streamer().load(cubemap->source, cubemap, 0);
+        cubemap->reduced = false;
+        ++_stats.restores;
+        report("restoring", *cubemap);
+      }
+    }
+    total += cubemap->residentBytes();
+  }
+  _stats.residentBytes = total;
+
+  // The least recently used cubemaps past the grace period, overall and among
+  // those still at full size
+  std::shared_ptr<Cubemap> oldest, oldestFull;
+  for (const std::shared_ptr<Cubemap>& cubemap : cubemaps)
+  {
+    if (cubemap->streaming() || !cubemap->resident.texture || _frame - cubemap->lastUsedFrame <= GRACE_FRAMES)
+    {
+      continue;
+    }
+    if (!oldest || cubemap->lastUsedFrame < oldest->lastUsedFrame)
+    {
+      oldest = cubemap;
+    }
+    if (cubemap->resident.baseLevel == 0 && (!oldestFull || cubemap->lastUsedFrame < oldestFull->lastUsedFrame))
+    {
+      oldestFull = cubemap;
+    }
+  }
+
+  // At most one reduction per frame, so freeing a lot of memory never lands in a single frame
+  if (oldest && total > _stats.budgetBytes)
+  {
+    if (oldest->resident.baseLevel < MAX_DROPPED_LEVELS && downgrade(oldest))
+    {
+      report("over budget, dropped a mip level of", *oldest);
+    }
+    else
+    {
+      evict(oldest);
+      report("over budget, evicted", *oldest);
+    }
+  }
+  else if (oldestFull && _frame - oldestFull->lastUsedFrame > IDLE_FRAMES && downgrade(oldestFull))
+  {
+    report("idle, dropped a mip level of", *oldestFull);
+  }
+}
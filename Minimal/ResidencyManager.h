@@ -0,0 +1,55 @@
+#ifndef RESIDENCYMANAGER_H
+#define RESIDENCYMANAGER_H
+
+#include <memory>
+#include "Cubemap.h"
+#include "TextureCache.h"
+
+// Keeps the cache's cubemaps within a texture memory budget. Every cubemap
+// remembers the last frame it was drawn in; when the total goes over budget the
+// least recently used ones first lose their top mips (each step quarters their
+// size) and are then evicted to the placeholder. Anything left unused for a
+// long while drops its top mip even under budget. As soon as a reduced cubemap
+// is drawn again it is re-streamed at full resolution in the background and
+// keeps drawing what it has until then.
+class ResidencyManager
+{
+public:
+  static const size_t DEFAULT_BUDGET = 512 * 1024 * 1024;
+  // Cubemaps drawn within this many frames are never reduced
+  static const unsigned int GRACE_FRAMES = 90;
+  // Unused this long, a cubemap drops one level even when under budget
+  static const unsigned int IDLE_FRAMES = 900;
+  // Levels dropped before an over-budget cubemap is evicted outright
+  static const int MAX_DROPPED_LEVELS = 2;
+
+  struct Stats
+  {
+    size_t residentBytes;
+    size_t budgetBytes;
+    unsigned int downgrades;
+    unsigned int evictions;
+    unsigned int restores;
+  };
+
+  explicit ResidencyManager(TextureCache& cache, size_t budgetBytes = DEFAULT_BUDGET);
+
+  void setBudget(size_t budgetBytes) { _stats.budgetBytes = budgetBytes; }
+  const Stats& stats() const { return _stats; }
+
+  // Collects last frame's draws, restores what came back into use and
+  // enforces the budget. Call once per frame on the GL thread, before the
+  // cache's update.
+  void update();
+
+private:
+  bool downgrade(const std::shared_ptr<Cubemap>& cubemap);
+  void evict(const std::shared_ptr<Cubemap>& cubemap);
+  void report(const char* action, const Cubemap& cubemap) const;
+
+  TextureCache& _cache;
+  unsigned int _frame{0};
+  Stats _stats;
+};
+
+#endif
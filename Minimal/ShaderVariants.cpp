@@ -0,0 +1,187 @@
+#include "ShaderVariants.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include "AssetPack.h"
+
+namespace
+{
+  // Includes nested deeper than this are taken to be a cycle
+  const int maxIncludeDepth = 16;
+
+  std::string directoryOf(const std::string& path)
+  {
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+  }
+
+  // The quoted file name of an '#include "file"' line, or empty
+  std::string includedName(const std::string& line)
+  {
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line.compare(start, 8, "#include") != 0)
+    {
+      return std::string();
+    }
+    size_t open = line.find('"', start + 8), close = line.find('"', open + 1);
+    if (open == std::string::npos || close == std::string::npos)
+    {
+      return std::string();
+    }
+    return line.substr(open + 1, close - open - 1);
+  }
+
+  bool expand(const std::string& path, int depth, std::ostringstream& out, std::vector<std::string>& files,
+              std::string& error)
+  {
+    if (depth > maxIncludeDepth)
+    {
+      error = path + ": includes nest too deeply (does a file include itself?)";
+      return false;
+    }
+    Asset asset;
+    if (!openAsset(path, asset))
+    {
+      error = "could not open " + path;
+      return false;
+    }
+
+    int fileNumber = (int)files.size();
+    files.push_back(path);
+    std::istringstream in(std::string(reinterpret_cast<const char*>(asset.data), asset.size));
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line))
+    {
+      ++lineNumber;
+      std::string included = includedName(line);
+      if (included.empty())
+      {
+        out << line << '\n';
+        // #version must come first, so the main file's numbering starts after it
+        if (depth == 0 && line.compare(0, 8, "#version") == 0)
+        {
+          out << "#line " << lineNumber + 1 << " " << fileNumber << '\n';
+        }
+        continue;
+      }
+      out << "#line 1 " << files.size() << '\n';
+      if (!expand(directoryOf(path) + included, depth + 1, out, files, error))
+      {
+        return false;
+      }
+      out << "#line " << lineNumber + 1 << " " << fileNumber << '\n';
+    }
+    return true;
+  }
+}
+
+bool expandIncludes(const std::string& path, std::string& source, std::vector<std::string>& files, std::string& error)
+{
+  std::ostringstream out;
+  files.clear();
+  if (!expand(path, 0, out, files, error))
+  {
+    return false;
+  }
+  source = out.str();
+  return true;
+}
+
+std::string specialize(const std::string& source, const std::vector<std::string>& defines)
+{
+  // The #line that expandIncludes put after #version renumbers what follows,
+  // so the defines don't shift the line numbers in errors
+  size_t insert = source.compare(0, 8, "#version") == 0 ? source.find('\n') + 1 : 0;
+  std::string block;
+  for (const std::string& define : defines)
+  {
+    block += "#define " + define + "\n";
+  }
+  return source.substr(0, insert) + block + source.substr(insert);
+}
+
+ShaderVariants::ShaderVariants(const std::string& vertexPath, const std::string& fragmentPath,
+                               std::vector<std::string> options, const std::vector<std::string>& defines)
+  : _options(std::move(options))
+{
+  std::string name = vertexPath + " + " + fragmentPath;
+  for (const std::string& define : defines)
+  {
+    name += " " + define;
+  }
+  std::string vertex, fragment, error;
+  std::vector<std::string> vertexFiles, fragmentFiles;
+  bool expanded = expandIncludes(vertexPath, vertex, vertexFiles, error) &&
+    expandIncludes(fragmentPath, fragment, fragmentFiles, error);
+  if (!expanded)
+  {
+    std::cout << "Shader " << name << ": " << error << std::endl;
+  }
+  for (const std::vector<std::string>* files : {&vertexFiles, &fragmentFiles})
+  {
+    _sourceFiles += "\n ";
+    for (size_t i = 0; i < files->size(); i++)
+    {
+      _sourceFiles += " " + std::to_string(i) + ": " + (*files)[i];
+    }
+  }
+
+  // Every combination goes to the driver now, so they all compile together
+  unsigned int variants = 1u << _options.size();
+  for (unsigned int key = 0; key < variants; key++)
+  {
+    std::vector<std::string> variantDefines = defines;
+    std::string variantName = name;
+    for (size_t i = 0; i < _options.size(); i++)
+    {
+      if (key & (1u << i))
+      {
+        variantDefines.push_back(_options[i]);
+        variantName += " " + _options[i];
+      }
+    }
+    std::vector<ShaderStage> stages;
+    if (expanded)
+    {
+      stages.push_back(ShaderStage{GL_VERTEX_SHADER, specialize(vertex, variantDefines)});
+      stages.push_back(ShaderStage{GL_FRAGMENT_SHADER, specialize(fragment, variantDefines)});
+    }
+    _programs.push_back(SubmitProgram(variantName, stages));
+  }
+  _reported.assign(_programs.size(), false);
+}
+
+unsigned int ShaderVariants::flag(const std::string& option) const
+{
+  auto found = std::find(_options.begin(), _options.end(), option);
+  return found == _options.end() ? 0 : 1u << (found - _options.begin());
+}
+
+bool ShaderVariants::ready() const
+{
+  for (const std::shared_ptr<PendingProgram>& program : _programs)
+  {
+    if (!program->ready())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+GLuint ShaderVariants::get(unsigned int key)
+{
+  if (key >= _programs.size())
+  {
+    return 0;
+  }
+  GLuint program = _programs[key]->get();
+  if (!program && !_reported[key])
+  {
+    _reported[key] = true;
+    std::cout << "Source strings in the errors above:" << _sourceFiles << std::endl;
+  }
+  return program;
+}
@@ -0,0 +1,54 @@
+#ifndef SHADERVARIANTS_H
+#define SHADERVARIANTS_H
+
+#include <GL/glew.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "shader.h"
+
+// Reads 'path' (out of the asset pack when it has it) and splices in every
+// '#include "file"', resolved next to the including file. Each spliced file
+// gets its own GLSL source-string number in #line directives, so compile errors
+// name the line in the file it came from; the numbers follow the order of
+// 'files', which lists the main file first. False with 'error' set when a file
+// is missing or includes itself.
+bool expandIncludes(const std::string& path, std::string& source, std::vector<std::string>& files,
+                    std::string& error);
+
+// Inserts "#define <name>" for each of 'defines' right after the #version line
+std::string specialize(const std::string& source, const std::vector<std::string>& defines);
+
+// One shader with a declared set of on/off #define options, compiled once per
+// combination. A variant's key has bit i set when options[i] is defined, so the
+// draw code picks its specialization with a mask instead of branching inside
+// the shader. Every variant is submitted together and only waited on when it
+// is first drawn.
+class ShaderVariants
+{
+public:
+  // 'defines' are set in every variant
+  ShaderVariants(const std::string& vertexPath, const std::string& fragmentPath, std::vector<std::string> options,
+                 const std::vector<std::string>& defines = {});
+
+  ShaderVariants(const ShaderVariants&) = delete;
+  ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+  // The key bit for 'option'; 0 for an option that wasn't declared
+  unsigned int flag(const std::string& option) const;
+
+  // The program for 'key', waiting for it the first time. 0 if it failed.
+  GLuint get(unsigned int key);
+  // Never blocks; PendingProgram::ready() for every variant
+  bool ready() const;
+
+  size_t count() const { return _programs.size(); }
+
+private:
+  std::vector<std::string> _options;
+  std::string _sourceFiles; // what the source-string numbers in error logs refer to
+  std::vector<std::shared_ptr<PendingProgram>> _programs;
+  std::vector<bool> _reported;
+};
+
+#endif
@@ -3,22 +3,107 @@
 #include <GL/glew.h>
 #include <iostream>
 #include <vector>
+#include <glm/matrix.hpp>
+#include "GLState.h"
+#include "KTXFile.h"
 
 
-Skybox::Skybox(const std::string dir) : TexturedCube(dir)
+Skybox::Skybox(const std::string dir, int faceSize) : TexturedCube(dir, faceSize)
 {
+  atInfinity();
+}
+
+Skybox::Skybox(std::shared_ptr<Cubemap> cubeMap) : TexturedCube(cubeMap)
+{
+  atInfinity();
+}
+
+Skybox::Skybox(std::shared_ptr<Cubemap> base, std::shared_ptr<Cubemap> residual)
+  : TexturedCube(base), residual(residual)
+{
+  atInfinity();
+}
+
+void Skybox::atInfinity()
+{
+  // On the far plane, behind everything else: it never writes depth, and only
+  // draws where the depth buffer still holds the clear value
+  cullFace = 0;
+  depthWrite = GL_FALSE;
+  depthFunc = GL_LEQUAL;
 }
 
 Skybox::~Skybox()
 {
 }
 
+ProgramInterface Skybox::skyInterface(bool residual)
+{
+  // The triangle comes from gl_VertexID, so there are no attributes
+  ProgramInterface expected;
+  expected.uniforms.push_back({"inverseViewProjection", GL_FLOAT_MAT4});
+  expected.uniforms.push_back({"skybox", GL_SAMPLER_CUBE});
+  if (residual)
+  {
+    expected.uniforms.push_back({"residual", GL_SAMPLER_CUBE});
+    expected.uniforms.push_back({"residualScale", GL_FLOAT});
+  }
+  return expected;
+}
+
+void Skybox::setSkyUniforms(unsigned skyboxShader, const glm::mat4& p, const glm::mat4& v)
+{
+  if (skyProgram != skyboxShader)
+  {
+    const ProgramReflection& reflection = ProgramReflection::of(skyboxShader);
+    uInverseViewProjection = reflection.mat4("inverseViewProjection");
+    uSky = reflection.sampler("skybox", GL_SAMPLER_CUBE);
+    if (residual)
+    {
+      uResidual = reflection.sampler("residual", GL_SAMPLER_CUBE);
+      uResidualScale = reflection.scalar("residualScale");
+    }
+    skyProgram = skyboxShader;
+  }
+  // Only the rotation: the sky is infinitely far away
+  uInverseViewProjection.set(glm::inverse(p * glm::mat4(glm::mat3(v))));
+  uSky.set(0);
+  if (residual)
+  {
+    uResidual.set(1);
+    uResidualScale.set(STEREO_RESIDUAL_SCALE);
+  }
+}
+
 void Skybox::draw(unsigned skyboxShader, const glm::mat4& p, const glm::mat4& v)
 {
-  glEnable(GL_CULL_FACE);
-  glCullFace(GL_BACK);
-  glDepthMask(GL_FALSE);
-  TexturedCube::draw(skyboxShader, p, glm::mat4(glm::mat3(v)));
-  glDepthMask(GL_TRUE);
-  glCullFace(GL_FRONT);
+  bindState(skyboxShader);
+  // The residual's placeholder is mid-grey, i.e. no difference, so until it
+  // has streamed in this eye simply draws the base
+  if (residual)
+  {
+    GLState::shared().bindTexture(1, GL_TEXTURE_CUBE_MAP, residual->textureForDraw());
+  }
+  setSkyUniforms(skyboxShader, p, v);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+DrawPacket Skybox::packet(unsigned skyboxShader, unsigned eyes)
+{
+  DrawPacket packet = basePacket(skyboxShader, eyes);
+  packet.layer = DrawPacket::Background;
+  packet.rotationOnly = true;
+  if (residual)
+  {
+    packet.textures[1] = residual->textureForDraw();
+  }
+  packet.draw = drawPacket;
+  return packet;
+}
+
+void Skybox::drawPacket(const DrawPacket& packet, const glm::mat4& p, const glm::mat4& v)
+{
+  Skybox* skybox = static_cast<Skybox*>(packet.object);
+  skybox->setSkyUniforms(packet.program, p, v);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
 }
@@ -8,9 +8,36 @@ class Skybox : public TexturedCube
 {
 public:
 
-  Skybox(const std::string dir);
+  Skybox(const std::string dir, int faceSize = 0);
+  explicit Skybox(std::shared_ptr<Cubemap> cubeMap);
+  // A stereo eye drawn as 'base' (the other eye) plus a baked residual
+  Skybox(std::shared_ptr<Cubemap> base, std::shared_ptr<Cubemap> residual);
   ~Skybox();
 
+  // The sky at infinity as one full-screen triangle, with a program built
+  // from sky.vert: it is on the far plane and only fills pixels nothing else
+  // has covered, so draw it after the opaque geometry. toWorld is not used.
   void draw(unsigned int skyboxShader, const glm::mat4& p, const glm::mat4& v);
+  // draw() as a background RenderQueue packet for 'eyes'
+  DrawPacket packet(unsigned int skyboxShader, unsigned int eyes);
+
+  // What a sky program must have for draw(), with or without the residual
+  static ProgramInterface skyInterface(bool residual);
+
+  // Empty unless this eye is stored as a residual
+  std::shared_ptr<Cubemap> residual;
+  // Resolved once for the program in skyProgram
+  GLuint skyProgram{0};
+  UniformHandle<glm::mat4> uInverseViewProjection;
+  UniformHandle<GLint> uSky;
+  UniformHandle<GLint> uResidual;
+  UniformHandle<float> uResidualScale;
+
+private:
+  void atInfinity();
+  // Sets the uniforms of 'skyboxShader', which is current with the cubemap
+  // (and any residual) bound
+  void setSkyUniforms(unsigned int skyboxShader, const glm::mat4& p, const glm::mat4& v);
+  static void drawPacket(const DrawPacket& packet, const glm::mat4& p, const glm::mat4& v);
 };
 #endif
@@ -0,0 +1,98 @@
+#include "StereoPass.h"
+
+#include <iostream>
+#include "GLState.h"
+#include "ProgramReflection.h"
+
+namespace
+{
+  // The std140 layout of the StereoEyes block
+  struct StereoEyes
+  {
+    glm::mat4 projection[2];
+    glm::mat4 view[2];
+    glm::vec4 viewport[2]; // NDC scale in xy, offset in zw
+  };
+}
+
+StereoPass::StereoPass()
+{
+  glGenBuffers(1, &_buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(StereoEyes), nullptr, GL_STREAM_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+StereoPass::~StereoPass()
+{
+  glDeleteBuffers(1, &_buffer);
+}
+
+void StereoPass::setEyes(const glm::mat4 projection[2], const glm::mat4 view[2], const glm::vec4 viewport[2],
+                         int targetWidth, int targetHeight)
+{
+  StereoEyes eyes;
+  for (int eye = 0; eye < 2; eye++)
+  {
+    eyes.projection[eye] = projection[eye];
+    eyes.view[eye] = view[eye];
+    // Maps the eye's own [-1, 1] NDC onto its rectangle of the whole target
+    float scaleX = viewport[eye][2] / targetWidth, scaleY = viewport[eye][3] / targetHeight;
+    eyes.viewport[eye] = glm::vec4(scaleX, scaleY, (2.0f * viewport[eye][0] + viewport[eye][2]) / targetWidth - 1.0f,
+                                   (2.0f * viewport[eye][1] + viewport[eye][3]) / targetHeight - 1.0f);
+  }
+  _targetWidth = targetWidth;
+  _targetHeight = targetHeight;
+
+  // Respecified whole, so last frame's draws can still read the old store
+  glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(StereoEyes), &eyes, GL_STREAM_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void StereoPass::bind(GLuint program)
+{
+  if (!_boundPrograms.insert(program).second)
+  {
+    return;
+  }
+  const ProgramReflection::Block* block = ProgramReflection::of(program).findBlock("StereoEyes");
+  if (!block)
+  {
+    std::cout << "Program " << program << " has no StereoEyes block; was it built with STEREO or MULTIVIEW?" << std::endl;
+    return;
+  }
+  glUniformBlockBinding(program, block->index, BINDING);
+}
+
+void StereoPass::begin()
+{
+  glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, _buffer);
+  if (_multiview)
+  {
+    _multiview->bindBothEyes();
+    return;
+  }
+  GLState& state = GLState::shared();
+  state.viewport(0, 0, _targetWidth, _targetHeight);
+  state.setEnabled(GL_CLIP_DISTANCE0, true);
+  state.setEnabled(GL_CLIP_DISTANCE1, true);
+}
+
+void StereoPass::end()
+{
+  if (!_multiview)
+  {
+    GLState::shared().setEnabled(GL_CLIP_DISTANCE0, false);
+    GLState::shared().setEnabled(GL_CLIP_DISTANCE1, false);
+  }
+}
+
+void StereoPass::beginEye(int eye, const glm::vec4& viewport)
+{
+  if (_multiview)
+  {
+    _multiview->bindEye(eye);
+  }
+  GLState::shared().viewport((GLint)viewport[0], (GLint)viewport[1], (GLsizei)viewport[2], (GLsizei)viewport[3]);
+}
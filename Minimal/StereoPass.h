@@ -0,0 +1,61 @@
+#ifndef STEREOPASS_H
+#define STEREOPASS_H
+
+#include <GL/glew.h>
+#include <set>
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+#include "Multiview.h"
+
+// Draws both eyes in one pass. Side by side, each draw is issued once with
+// twice the instances; a vertex shader built with STEREO (see
+// stereo_eyes.glsl) sends even instances to the left eye and odd ones to the
+// right, moves them into that eye's viewport and clips them to it. With a
+// MultiviewTarget, each draw reaches both eyes' layers by itself and the
+// shader is built with MULTIVIEW instead.
+class StereoPass
+{
+public:
+  // The uniform buffer binding point of the StereoEyes block
+  static const GLuint BINDING = 0;
+
+  StereoPass();
+  ~StereoPass();
+
+  StereoPass(const StereoPass&) = delete;
+  StereoPass& operator=(const StereoPass&) = delete;
+
+  // This frame's eyes. A viewport is x, y, width and height in pixels of the
+  // targetWidth x targetHeight render target.
+  void setEyes(const glm::mat4 projection[2], const glm::mat4 view[2], const glm::vec4 viewport[2], int targetWidth,
+               int targetHeight);
+
+  // Draws go to 'multiview' from now on, or side by side when it is null
+  void setTarget(MultiviewTarget* multiview) { _multiview = multiview; }
+  bool multiview() const { return _multiview != nullptr; }
+
+  // How many instances to draw per object in the pass
+  GLsizei instancesPerObject() const { return _multiview ? 1 : 2; }
+
+  // Points the StereoEyes block of 'program' at the eye data; the GL keeps
+  // that per program, so it is only done the first time
+  void bind(GLuint program);
+
+  // The whole target, with both eye clip planes on when side by side, and back
+  void begin();
+  void end();
+
+  // The target of a draw for 'eye' alone, within 'viewport'
+  void beginEye(int eye, const glm::vec4& viewport);
+
+private:
+  GLuint _buffer{0};
+  int _targetWidth{0}, _targetHeight{0};
+  std::set<GLuint> _boundPrograms;
+  MultiviewTarget* _multiview{nullptr};
+};
+
+#endif
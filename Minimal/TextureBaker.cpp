@@ -0,0 +1,184 @@
+#include "TextureBaker.h"
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "KTXFile.h"
+#include "MipGenerator.h"
+#include "PPMImage.h"
+#include "ThreadPool.h"
+
+namespace
+{
+  const char* faceFiles[6] = {"left.ppm", "right.ppm", "up.ppm", "down.ppm", "back.ppm", "front.ppm"};
+
+  bool loadFaces(const std::string& directory, PPMImage faces[6])
+  {
+    for (int i = 0; i < 6; i++)
+    {
+      std::string path = "./" + directory + "/" + faceFiles[i];
+      PPMError error = loadPPM(path, faces[i]);
+      if (error != PPMError::None)
+      {
+        std::cerr << "error baking " << path << ": " << describe(error) << std::endl;
+        return false;
+      }
+      if (faces[i].width != faces[i].height || faces[i].width != faces[0].width)
+      {
+        std::cerr << "error baking " << path << ": faces must be square and all the same size" << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+int bakeCubemap(const std::string& directory, BlockFormat format)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+
+  PPMImage faces[6];
+  if (!loadFaces(directory, faces))
+  {
+    return -1;
+  }
+
+  const int size = faces[0].width;
+  const int levels = mipLevelCount(size, size);
+  std::vector<std::vector<unsigned char>> images(levels * 6);
+
+  // Faces in parallel; generateMips and compressImage also spread their rows over the pool
+  parallelFor(6, [&](size_t face)
+  {
+    images[face] = compressImage(faces[face].pixels, size, size, format);
+    std::vector<MipLevel> mips = generateMips(faces[face].pixels, size, size);
+    for (int l = 1; l < levels; l++)
+    {
+      const MipLevel& mip = mips[l - 1];
+      images[l * 6 + face] = compressImage(mip.rgb.data(), mip.width, mip.height, format);
+    }
+  });
+
+  std::string output = ktxPathFor("./" + directory);
+  if (!writeKTX(output, blockGLFormat(format), blockGLBaseFormat(format), size, levels, images))
+  {
+    std::cerr << "error writing " << output << std::endl;
+    return -1;
+  }
+
+  size_t compressedBytes = 0;
+  for (const std::vector<unsigned char>& image : images)
+  {
+    compressedBytes += image.size();
+  }
+  size_t rawBytes = faces[0].byteSize() * 6;
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cout << "Baked " << output << ": " << size << "x" << size << ", " << levels << " levels, "
+    << blockFormatName(format) << ", " << compressedBytes / 1024 << " KB (raw level 0 was " << rawBytes / 1024
+    << " KB) in " << std::chrono::duration<double>(end - start).count() << " s" << std::endl;
+  return 0;
+}
+
+int bakeStereoResidual(const std::string& baseDirectory, const std::string& eyeDirectory, bool force)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+
+  PPMImage base[6], eye[6];
+  if (!loadFaces(baseDirectory, base) || !loadFaces(eyeDirectory, eye))
+  {
+    return -1;
+  }
+  if (base[0].width != eye[0].width || base[0].width < 2)
+  {
+    std::cerr << "error baking " << eyeDirectory << ": both eyes must have the same, even face size" << std::endl;
+    return -1;
+  }
+
+  // Each residual texel is the mean difference over a 2x2 block; the error is
+  // measured on the full-resolution eye reconstructed from it
+  const int size = base[0].width, half = size / 2;
+  std::vector<std::vector<unsigned char>> residuals(6);
+  double squaredError[6] = {};
+  parallelFor(6, [&](size_t face)
+  {
+    const unsigned char* b = base[face].pixels;
+    const unsigned char* e = eye[face].pixels;
+    std::vector<unsigned char>& residual = residuals[face];
+    residual.resize(size_t(half) * half * 3);
+    for (int y = 0; y < half; y++)
+    {
+      for (int x = 0; x < half; x++)
+      {
+        for (int c = 0; c < 3; c++)
+        {
+          size_t texels[4] = {(size_t(y * 2) * size + x * 2) * 3 + c, (size_t(y * 2) * size + x * 2 + 1) * 3 + c,
+                              (size_t(y * 2 + 1) * size + x * 2) * 3 + c, (size_t(y * 2 + 1) * size + x * 2 + 1) * 3 + c};
+          int sum = 0;
+          for (size_t t : texels)
+          {
+            sum += int(e[t]) - int(b[t]);
+          }
+          float q = std::round(sum / (4.0f * STEREO_RESIDUAL_SCALE)) + 128.0f;
+          unsigned char stored = (unsigned char)std::min(255.0f, std::max(0.0f, q));
+          residual[(size_t(y) * half + x) * 3 + c] = stored;
+
+          float delta = (stored - 128.0f) * STEREO_RESIDUAL_SCALE;
+          for (size_t t : texels)
+          {
+            float rebuilt = std::min(255.0f, std::max(0.0f, b[t] + delta));
+            squaredError[face] += (rebuilt - e[t]) * (rebuilt - e[t]);
+          }
+        }
+      }
+    }
+  });
+
+  double mse = 0;
+  for (double error : squaredError)
+  {
+    mse += error;
+  }
+  mse /= double(eye[0].byteSize()) * 6;
+  double psnr = mse > 0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+  if (psnr < MIN_RESIDUAL_PSNR && !force)
+  {
+    std::cerr << eyeDirectory << " would be rebuilt from " << baseDirectory << " at only " << psnr << " dB (below "
+      << MIN_RESIDUAL_PSNR << " dB): the eyes differ too much for a residual to pay off, so they stay separate. "
+      << "Pass 'force' to bake it anyway." << std::endl;
+    return -1;
+  }
+
+  // The residual's chain is averaged as plain numbers, not as sRGB colors
+  const int levels = mipLevelCount(half, half);
+  std::vector<std::vector<unsigned char>> images(levels * 6);
+  parallelFor(6, [&](size_t face)
+  {
+    std::vector<MipLevel> mips = generateMips(residuals[face].data(), half, half, true, MipEncoding::Linear);
+    images[face] = std::move(residuals[face]);
+    for (int l = 1; l < levels; l++)
+    {
+      images[l * 6 + face] = std::move(mips[l - 1].rgb);
+    }
+  });
+
+  std::string output = ktxPathFor(residualPathFor("./" + eyeDirectory));
+  if (!writeKTX(output, GL_RGB8, GL_RGB, half, levels, images, GL_RGB, GL_UNSIGNED_BYTE))
+  {
+    std::cerr << "error writing " << output << std::endl;
+    return -1;
+  }
+
+  size_t residualBytes = 0;
+  for (const std::vector<unsigned char>& image : images)
+  {
+    residualBytes += image.size();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cout << "Baked " << output << ": " << half << "x" << half << " residual against " << baseDirectory << ", "
+    << residualBytes / 1024 << " KB (the eye's own level 0 was " << eye[0].byteSize() * 6 / 1024 << " KB), "
+    << psnr << " dB, in " << std::chrono::duration<double>(end - start).count() << " s" << std::endl;
+  return 0;
+}
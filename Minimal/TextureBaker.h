@@ -0,0 +1,20 @@
+#ifndef TEXTUREBAKER_H
+#define TEXTUREBAKER_H
+
+#include <string>
+#include "BlockCompress.h"
+
+// Bakes the six PPM faces in 'directory' into a block-compressed KTX cubemap
+// with a full mip chain, written next to it ("skybox" -> "skybox.ktx").
+// Invoked as "Minimal.exe --bake <dir> [bc1|bc7]". Returns 0 on success.
+int bakeCubemap(const std::string& directory, BlockFormat format);
+
+// Stores the cubemap in 'eyeDirectory' as a half-resolution residual against
+// the one in 'baseDirectory' (see residualPathFor), which the skybox shader adds
+// back on the GPU. Refuses when the reconstruction would fall below
+// MIN_RESIDUAL_PSNR unless 'force' is set. Invoked as
+// "Minimal.exe --bake-stereo <base> <eye> [force]". Returns 0 on success.
+const double MIN_RESIDUAL_PSNR = 30.0;
+int bakeStereoResidual(const std::string& baseDirectory, const std::string& eyeDirectory, bool force);
+
+#endif
@@ -0,0 +1,215 @@
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "AssetPack.h"
+#include "Equirect.h"
+#include "PPMImage.h"
+
+namespace
+{
+  // "./skybox/", "skybox" and "C:\...\Minimal\skybox" all name the same entry
+  std::string canonicalPath(const std::string& path)
+  {
+#ifdef _WIN32
+    char buffer[_MAX_PATH];
+    if (!_fullpath(buffer, path.c_str(), _MAX_PATH))
+    {
+      return path;
+    }
+    std::string canonical = buffer;
+    std::transform(canonical.begin(), canonical.end(), canonical.begin(), [](char c) { return (char)tolower(c); });
+    std::replace(canonical.begin(), canonical.end(), '/', '\\');
+    while (canonical.size() > 3 && canonical.back() == '\\')
+    {
+      canonical.pop_back();
+    }
+    return canonical;
+#else
+    char buffer[PATH_MAX];
+    if (!realpath(path.c_str(), buffer))
+    {
+      return path;
+    }
+    return buffer;
+#endif
+  }
+
+  uint64_t mix(uint64_t h)
+  {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  // Four independent multiply-xor lanes so the hash isn't bound by the
+  // latency of a single multiply chain
+  uint64_t hashBytes(const unsigned char* data, size_t size)
+  {
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t lanes[4] = {0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL, 0x9e3779b97f4a7c15ULL, 0x7f4a7c159e3779b9ULL};
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+      for (int lane = 0; lane < 4; lane++)
+      {
+        uint64_t word;
+        memcpy(&word, data + i + lane * 8, 8);
+        lanes[lane] = (lanes[lane] ^ word) * prime;
+      }
+    }
+    uint64_t h = mix(lanes[0]) ^ mix(lanes[1] + 1) ^ mix(lanes[2] + 2) ^ mix(lanes[3] + 3);
+    for (; i < size; i++)
+    {
+      h = (h ^ data[i]) * prime;
+    }
+    return mix(h ^ size);
+  }
+}
+
+TextureCache::TextureCache()
+{
+}
+
+TextureCache::~TextureCache()
+{
+  // Let in-flight hash jobs finish, so the cubemaps they hold are released
+  // here, on the GL thread
+  while (_hashesInFlight > 0)
+  {
+    _hashed->pop();
+    --_hashesInFlight;
+  }
+}
+
+uint64_t TextureCache::hashSources(const std::vector<std::string>& paths)
+{
+  uint64_t hash = 0;
+  for (size_t i = 0; i < paths.size(); i++)
+  {
+    Asset asset;
+    if (!openAsset(paths[i], asset))
+    {
+      return 0;
+    }
+    hash = mix(hash ^ (hashBytes(asset.data, asset.size) + i));
+  }
+  return hash ? hash : 1;
+}
+
+std::shared_ptr<Cubemap> TextureCache::acquire(const std::string& directory, int faceSize)
+{
+  // Six faces ignore the size, and 0 means the default for the panorama; made
+  // explicit, both requests for the same faces share one entry and one hash
+  if (!isEquirectangular(directory))
+  {
+    faceSize = 0;
+  }
+  else if (faceSize <= 0)
+  {
+    // Only the header is read; a panorama that can't be opened keeps 0 and fails when it streams
+    PPMImage image;
+    faceSize = loadPPM(directory, image) == PPMError::None ? defaultFaceSize(image.width) : 0;
+  }
+
+  std::string key = canonicalPath(directory);
+  if (faceSize > 0)
+  {
+    key += "@" + std::to_string(faceSize);
+  }
+  auto found = _byPath.find(key);
+  if (found != _byPath.end())
+  {
+    ++_stats.hits;
+    return found->second;
+  }
+
+  std::shared_ptr<Cubemap> cubemap = std::make_shared<Cubemap>(_streamer.placeholder());
+  cubemap->source = directory;
+  cubemap->faceSize = faceSize;
+  _byPath[key] = cubemap;
+
+  // The content hash decides between streaming and aliasing, so nothing is
+  // uploaded until it comes back
+  std::shared_ptr<ResultQueue<Hashed>> hashed = _hashed;
+  ThreadPool::shared().submit([hashed, cubemap, directory, faceSize]() mutable
+  {
+    uint64_t hash = hashSources(TextureStreamer::sourcesFor(directory));
+    if (hash && faceSize > 0)
+    {
+      hash = mix(hash ^ uint64_t(faceSize));
+    }
+    // Moved into the result, so the last reference is dropped on the GL
+    // thread, where ~Cubemap can delete its textures
+    hashed->push(Hashed{std::move(cubemap), directory, hash});
+  });
+  ++_hashesInFlight;
+  _reported = false;
+  return cubemap;
+}
+
+void TextureCache::update()
+{
+  Hashed hashed;
+  while (_hashed->tryPop(hashed))
+  {
+    --_hashesInFlight;
+    auto found = hashed.hash ? _byContent.find(hashed.hash) : _byContent.end();
+    if (found != _byContent.end() && !found->second.expired())
+    {
+      hashed.cubemap->alias = found->second.lock();
+      ++_stats.contentHits;
+    }
+    else
+    {
+      if (hashed.hash)
+      {
+        _byContent[hashed.hash] = hashed.cubemap;
+      }
+      _streamer.load(hashed.directory, hashed.cubemap);
+      ++_stats.misses;
+    }
+    hashed = Hashed();
+  }
+
+  _streamer.update();
+
+  if (!_reported && !busy())
+  {
+    Stats current = stats();
+    std::cout << "Texture cache: " << current.hits << " hits, " << current.contentHits << " content hits, "
+      << current.misses << " misses, " << current.residentBytes / (1024 * 1024) << " MB resident" << std::endl;
+    _reported = true;
+  }
+}
+
+std::vector<std::shared_ptr<Cubemap>> TextureCache::entries() const
+{
+  std::vector<std::shared_ptr<Cubemap>> owners;
+  for (const auto& entry : _byPath)
+  {
+    if (!entry.second->alias)
+    {
+      owners.push_back(entry.second);
+    }
+  }
+  return owners;
+}
+
+TextureCache::Stats TextureCache::stats() const
+{
+  Stats current = _stats;
+  current.residentBytes = 0;
+  for (const auto& entry : _byPath)
+  {
+    current.residentBytes += entry.second->residentBytes();
+  }
+  return current;
+}
@@ -0,0 +1,75 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Cubemap.h"
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
+
+// Hands out shared cubemap handles so each texture is loaded once per process.
+// Requests are keyed by canonical path first; on a miss the source files are
+// hashed on the worker pool, and a directory whose content matches something
+// already loaded becomes an alias of it instead of a second copy in VRAM.
+// The cache keeps its own reference to everything it loads, for as long as it
+// lives, so a scene that is torn down and rebuilt finds its textures still
+// resident.
+class TextureCache
+{
+public:
+  struct Stats
+  {
+    unsigned int hits;        // same canonical path
+    unsigned int contentHits; // different path, identical files
+    unsigned int misses;      // actually streamed from disk
+    size_t residentBytes;
+  };
+
+  TextureCache();
+  ~TextureCache();
+
+  TextureCache(const TextureCache&) = delete;
+  TextureCache& operator=(const TextureCache&) = delete;
+
+  // Returns immediately; the handle draws as the placeholder until loaded.
+  // 'faceSize' applies to an equirectangular source, and the same panorama at
+  // two sizes is two entries.
+  std::shared_ptr<Cubemap> acquire(const std::string& directory, int faceSize = 0);
+
+  // Resolves finished content hashes and advances streaming. Call once per
+  // frame on the GL thread.
+  void update();
+
+  // Every cubemap that owns its texture (aliases excluded)
+  std::vector<std::shared_ptr<Cubemap>> entries() const;
+
+  bool busy() const { return _hashesInFlight > 0 || _streamer.busy(); }
+  Stats stats() const;
+
+  TextureStreamer& streamer() { return _streamer; }
+
+private:
+  struct Hashed
+  {
+    std::shared_ptr<Cubemap> cubemap;
+    std::string directory;
+    uint64_t hash; // 0 when the sources couldn't be read
+  };
+
+  static uint64_t hashSources(const std::vector<std::string>& paths);
+
+  TextureStreamer _streamer;
+  std::map<std::string, std::shared_ptr<Cubemap>> _byPath;
+  std::map<uint64_t, std::weak_ptr<Cubemap>> _byContent;
+  // Shared with the jobs, since a worker may still be inside push() after
+  // the destructor's last pop() returns
+  std::shared_ptr<ResultQueue<Hashed>> _hashed{std::make_shared<ResultQueue<Hashed>>()};
+  size_t _hashesInFlight{0};
+  Stats _stats{0, 0, 0, 0};
+  bool _reported{false};
+};
+
+#endif
@@ -0,0 +1,481 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include "AssetPack.h"
+#include "Equirect.h"
+#include "MipGenerator.h"
+
+TextureStreamer::TextureStreamer(size_t slotSize, unsigned int slotCount)
+  : _slotSize(slotSize)
+{
+  createPlaceholder();
+
+  size_t ringSize = slotSize * slotCount;
+  glGenBuffers(1, &_pbo);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbo);
+  if (GLEW_ARB_buffer_storage)
+  {
+    // Map the whole ring once and keep it mapped; the fences do the synchronization
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ringSize, nullptr, flags);
+    _persistentPtr = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ringSize, flags));
+    _persistent = _persistentPtr != nullptr;
+  }
+  if (!_persistent)
+  {
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, ringSize, nullptr, GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  for (unsigned int i = 0; i < slotCount; i++)
+  {
+    _slots.push_back(Slot{i * slotSize, nullptr});
+  }
+}
+
+TextureStreamer::~TextureStreamer()
+{
+  // Let in-flight decodes finish, so the cubemaps they hold are released
+  // here, on the GL thread
+  while (_decodesInFlight > 0)
+  {
+    _decoded->pop();
+    --_decodesInFlight;
+  }
+
+  for (Slot& slot : _slots)
+  {
+    if (slot.fence)
+    {
+      glDeleteSync(slot.fence);
+    }
+  }
+  if (_persistent)
+  {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbo);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+  glDeleteBuffers(1, &_pbo);
+  glDeleteTextures(1, &_placeholder);
+}
+
+void TextureStreamer::createPlaceholder()
+{
+  const unsigned char grey[3] = {128, 128, 128};
+  glGenTextures(1, &_placeholder);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, _placeholder);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (unsigned int i = 0; i < 6; i++)
+  {
+    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, grey);
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
+
+TextureStreamer::Decoded TextureStreamer::decodeFace(const std::shared_ptr<Cubemap>& cubemap, unsigned int face,
+                                                      const std::string& path, int baseLevel)
+{
+  Decoded decoded;
+  decoded.cubemap = cubemap;
+  decoded.path = path;
+  decoded.internalFormat = GL_RGB8;
+
+  PPMImage image;
+  PPMError error = decodePPM(path, image);
+  if (error != PPMError::None)
+  {
+    decoded.error = describe(error);
+    return decoded;
+  }
+  if (image.width != image.height)
+  {
+    decoded.error = "faces must be square";
+    return decoded;
+  }
+
+  // Level 0 streams straight out of the mapping, the rest out of the generated
+  // chain; levels above 'baseLevel' are generated but never uploaded
+  std::shared_ptr<std::vector<MipLevel>> mips =
+    std::make_shared<std::vector<MipLevel>>(generateMips(image.pixels, image.width, image.height));
+  int levels = (int)mips->size() + 1;
+  decoded.baseLevel = std::min(baseLevel, levels - 1);
+  decoded.size = std::max(1, image.width >> decoded.baseLevel);
+  decoded.levels = levels - decoded.baseLevel;
+  if (decoded.baseLevel == 0)
+  {
+    decoded.images.push_back(ImageUpload{cubemap, face, 0, image.source, image.pixels, image.width, image.height,
+                                         GL_RGB, GL_UNSIGNED_BYTE, size_t(image.width) * 3, image.height, 0});
+  }
+  for (int level = std::max(1, decoded.baseLevel); level < levels; level++)
+  {
+    const MipLevel& mip = (*mips)[level - 1];
+    decoded.images.push_back(ImageUpload{cubemap, face, level - decoded.baseLevel, mips, mip.rgb.data(), mip.width,
+                                         mip.height, GL_RGB, GL_UNSIGNED_BYTE, size_t(mip.width) * 3, mip.height, 0});
+  }
+  return decoded;
+}
+
+TextureStreamer::Decoded TextureStreamer::decodeKTX(const std::shared_ptr<Cubemap>& cubemap, const std::string& path,
+                                                     int baseLevel)
+{
+  Decoded decoded;
+  decoded.cubemap = cubemap;
+  decoded.path = path;
+
+  KTXError error = loadKTX(path, decoded.ktx);
+  if (error != KTXError::None)
+  {
+    decoded.error = describe(error);
+    return decoded;
+  }
+  decoded.ktx.prefetch();
+  decoded.internalFormat = decoded.ktx.glInternalFormat;
+  decoded.baseLevel = std::min(baseLevel, decoded.ktx.levels - 1);
+  decoded.size = std::max(1, decoded.ktx.size >> decoded.baseLevel);
+  decoded.levels = decoded.ktx.levels - decoded.baseLevel;
+
+  for (int level = decoded.baseLevel; level < decoded.ktx.levels; level++)
+  {
+    int levelSize = std::max(1, decoded.ktx.size >> level);
+    for (unsigned int face = 0; face < 6; face++)
+    {
+      const KTXCubemap::Image& image = decoded.ktx.image(level, face);
+      // Compressed data goes up in rows of 4x4 blocks
+      int rowCount = decoded.ktx.compressed() ? (levelSize + 3) / 4 : levelSize;
+      decoded.images.push_back(ImageUpload{cubemap, face, level - decoded.baseLevel, decoded.ktx.source, image.data,
+                                           levelSize, levelSize, decoded.ktx.glFormat, decoded.ktx.glType,
+                                           image.bytes / rowCount, rowCount, 0});
+    }
+  }
+  return decoded;
+}
+
+TextureStreamer::Decoded TextureStreamer::decodeEquirect(const std::shared_ptr<Cubemap>& cubemap, const std::string& path,
+                                                          int faceSize, int baseLevel)
+{
+  Decoded decoded;
+  decoded.cubemap = cubemap;
+  decoded.path = path;
+  decoded.internalFormat = GL_RGB8;
+
+  PPMImage image;
+  PPMError error = decodePPM(path, image);
+  if (error != PPMError::None)
+  {
+    decoded.error = describe(error);
+    return decoded;
+  }
+  if (image.width < 2 || image.height < 2)
+  {
+    decoded.error = "panorama is too small";
+    return decoded;
+  }
+
+  // The faces are resampled in bands across the pool, then each face's chain
+  // is generated in parallel with the others
+  struct Faces
+  {
+    std::vector<unsigned char> rgb[6];
+    std::vector<MipLevel> mips[6];
+  };
+  std::shared_ptr<Faces> faces = std::make_shared<Faces>();
+  int size = faceSize > 0 ? faceSize : defaultFaceSize(image.width);
+  equirectToCubemap(image.pixels, image.width, image.height, size, faces->rgb);
+  parallelFor(6, [&](size_t face)
+  {
+    faces->mips[face] = generateMips(faces->rgb[face].data(), size, size);
+  });
+
+  int levels = (int)faces->mips[0].size() + 1;
+  decoded.baseLevel = std::min(baseLevel, levels - 1);
+  decoded.size = std::max(1, size >> decoded.baseLevel);
+  decoded.levels = levels - decoded.baseLevel;
+  for (unsigned int face = 0; face < 6; face++)
+  {
+    if (decoded.baseLevel == 0)
+    {
+      decoded.images.push_back(ImageUpload{cubemap, face, 0, faces, faces->rgb[face].data(), size, size, GL_RGB,
+                                           GL_UNSIGNED_BYTE, size_t(size) * 3, size, 0});
+    }
+    for (int level = std::max(1, decoded.baseLevel); level < levels; level++)
+    {
+      const MipLevel& mip = faces->mips[face][level - 1];
+      decoded.images.push_back(ImageUpload{cubemap, face, level - decoded.baseLevel, faces, mip.rgb.data(), mip.width,
+                                           mip.height, GL_RGB, GL_UNSIGNED_BYTE, size_t(mip.width) * 3, mip.height,
+                                           0});
+    }
+  }
+  return decoded;
+}
+
+std::vector<std::string> TextureStreamer::sourcesFor(const std::string& directory)
+{
+  static const char* faces[6] = {"left.ppm", "right.ppm", "up.ppm", "down.ppm", "back.ppm", "front.ppm"};
+
+  if (isEquirectangular(directory))
+  {
+    return std::vector<std::string>{directory};
+  }
+
+  std::string ktxPath = ktxPathFor(directory);
+  Asset probe;
+  if (openAsset(ktxPath, probe))
+  {
+    return std::vector<std::string>{ktxPath};
+  }
+  std::vector<std::string> paths;
+  for (const char* face : faces)
+  {
+    paths.push_back(directory + face);
+  }
+  return paths;
+}
+
+std::shared_ptr<Cubemap> TextureStreamer::load(const std::string& directory)
+{
+  std::shared_ptr<Cubemap> cubemap = std::make_shared<Cubemap>(_placeholder);
+  load(directory, cubemap);
+  return cubemap;
+}
+
+void TextureStreamer::load(const std::string& directory, std::shared_ptr<Cubemap> cubemap, int baseLevel)
+{
+  cubemap->source = directory;
+  cubemap->placeholder = _placeholder;
+
+  std::vector<std::string> sources = sourcesFor(directory);
+  cubemap->pendingDecodes = (unsigned int)sources.size();
+  _decodesInFlight += cubemap->pendingDecodes;
+  if (isEquirectangular(directory))
+  {
+    int faceSize = cubemap->faceSize;
+    submit(cubemap, [directory, faceSize, baseLevel](const std::shared_ptr<Cubemap>& target)
+    {
+      return decodeEquirect(target, directory, faceSize, baseLevel);
+    });
+  }
+  else if (sources.size() == 1)
+  {
+    std::string ktxPath = sources[0];
+    submit(cubemap, [ktxPath, baseLevel](const std::shared_ptr<Cubemap>& target)
+    {
+      return decodeKTX(target, ktxPath, baseLevel);
+    });
+  }
+  else
+  {
+    for (unsigned int i = 0; i < sources.size(); i++)
+    {
+      std::string path = sources[i];
+      submit(cubemap, [i, path, baseLevel](const std::shared_ptr<Cubemap>& target)
+      {
+        return decodeFace(target, i, path, baseLevel);
+      });
+    }
+  }
+}
+
+void TextureStreamer::submit(std::shared_ptr<Cubemap> cubemap,
+                             std::function<Decoded(const std::shared_ptr<Cubemap>&)> decode)
+{
+  std::shared_ptr<ResultQueue<Decoded>> decoded = _decoded;
+  ThreadPool::shared().submit([decoded, cubemap, decode]() mutable
+  {
+    Decoded result = decode(cubemap);
+    // The result carries the cubemap back; the job's own reference goes
+    // first, so the last one is always dropped on the GL thread, where
+    // ~Cubemap can delete its textures
+    cubemap.reset();
+    decoded->push(std::move(result));
+  });
+}
+
+bool TextureStreamer::allocate(Cubemap& cubemap, const Decoded& decoded)
+{
+  CubemapStorage& storage = cubemap.incoming;
+  if (storage.texture)
+  {
+    return decoded.size == storage.size && decoded.internalFormat == storage.internalFormat &&
+      decoded.levels == storage.levels;
+  }
+  if (decoded.images.empty() || decoded.images[0].rowBytes > _slotSize)
+  {
+    return false;
+  }
+
+  // Storage for every level of all six faces up front; the rows are filled in by later updates
+  storage.size = decoded.size;
+  storage.levels = decoded.levels;
+  storage.baseLevel = decoded.baseLevel;
+  storage.internalFormat = decoded.internalFormat;
+  glGenTextures(1, &storage.texture);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, storage.texture);
+  if (GLEW_ARB_texture_storage)
+  {
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, storage.levels, storage.internalFormat, storage.size, storage.size);
+  }
+  else if (decoded.images[0].format)
+  {
+    for (int level = 0; level < storage.levels; level++)
+    {
+      int levelSize = std::max(1, storage.size >> level);
+      for (unsigned int i = 0; i < 6; i++)
+      {
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level, storage.internalFormat, levelSize, levelSize, 0,
+                     decoded.images[0].format, decoded.images[0].type, nullptr);
+      }
+    }
+  }
+  else
+  {
+    // Compressed storage can't be allocated empty without ARB_texture_storage,
+    // so upload the container in one go instead of streaming it
+    uploadKTX(decoded.ktx, decoded.baseLevel);
+    return true;
+  }
+  setCubemapParameters(storage.levels);
+  return true;
+}
+
+unsigned char* TextureStreamer::mapSlot(const Slot& slot)
+{
+  if (_persistent)
+  {
+    return _persistentPtr + slot.offset;
+  }
+  // The slot's fence has signalled, so nothing can be reading this range
+  GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+  return static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, slot.offset, _slotSize, flags));
+}
+
+void TextureStreamer::unmapSlot()
+{
+  if (!_persistent)
+  {
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  }
+}
+
+void TextureStreamer::markReady(Cubemap& cubemap)
+{
+  // A refill keeps drawing the old texture until the new one is complete
+  if (!cubemap.streaming() && cubemap.incoming.texture)
+  {
+    cubemap.promote();
+  }
+}
+
+void TextureStreamer::finishDecode(Cubemap& cubemap)
+{
+  --_decodesInFlight;
+  --cubemap.pendingDecodes;
+  markReady(cubemap);
+}
+
+void TextureStreamer::finishUpload(Cubemap& cubemap)
+{
+  --cubemap.pendingUploads;
+  markReady(cubemap);
+}
+
+void TextureStreamer::update(size_t budgetBytes)
+{
+  Decoded decoded;
+  while (_decoded->tryPop(decoded))
+  {
+    Cubemap& cubemap = *decoded.cubemap;
+    if (!decoded.error.empty())
+    {
+      std::cout << "Cubemap texture failed to load at path: " << decoded.path << " (" << decoded.error << ")" << std::endl;
+    }
+    else if (!allocate(cubemap, decoded))
+    {
+      std::cout << "Cubemap texture has an unsupported or mismatched size: " << decoded.path << std::endl;
+    }
+    else if (!decoded.images[0].format && !GLEW_ARB_texture_storage)
+    {
+      // allocate() already uploaded the whole container
+    }
+    else
+    {
+      cubemap.pendingUploads += (unsigned int)decoded.images.size();
+      for (ImageUpload& image : decoded.images)
+      {
+        _uploads.push_back(std::move(image));
+      }
+    }
+    finishDecode(cubemap);
+    decoded = Decoded();
+  }
+
+  if (_uploads.empty())
+  {
+    return;
+  }
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbo);
+  size_t spent = 0;
+  while (!_uploads.empty() && spent < budgetBytes)
+  {
+    Slot& slot = _slots[_nextSlot];
+    if (slot.fence)
+    {
+      // Never stall the frame on the GPU; try again next update
+      GLenum state = glClientWaitSync(slot.fence, 0, 0);
+      if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+      {
+        break;
+      }
+      glDeleteSync(slot.fence);
+      slot.fence = nullptr;
+    }
+
+    ImageUpload& upload = _uploads.front();
+    size_t allowance = std::min(_slotSize, budgetBytes - spent);
+    int rows = std::min(int(std::max(allowance, upload.rowBytes) / upload.rowBytes), upload.rowCount - upload.nextRow);
+    size_t bytes = rows * upload.rowBytes;
+
+    unsigned char* dst = mapSlot(slot);
+    if (!dst)
+    {
+      break;
+    }
+    memcpy(dst, upload.data + upload.nextRow * upload.rowBytes, bytes);
+    unmapSlot();
+
+    const Cubemap& cubemap = *upload.cubemap;
+    GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + upload.face;
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap.incoming.texture);
+    if (upload.format)
+    {
+      // KTX pads uncompressed rows to 4 bytes; mapped PPM and generated rows are tight
+      glPixelStorei(GL_UNPACK_ALIGNMENT, upload.rowBytes % 4 == 0 ? 4 : 1);
+      glTexSubImage2D(target, upload.level, 0, upload.nextRow, upload.width, rows, upload.format, upload.type,
+                      (const GLvoid*)slot.offset);
+    }
+    else
+    {
+      int y = upload.nextRow * 4;
+      glCompressedTexSubImage2D(target, upload.level, 0, y, upload.width, std::min(rows * 4, upload.height - y),
+                                cubemap.incoming.internalFormat, (GLsizei)bytes, (const GLvoid*)slot.offset);
+    }
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _nextSlot = (_nextSlot + 1) % _slots.size();
+
+    spent += bytes;
+    upload.nextRow += rows;
+    if (upload.nextRow == upload.rowCount)
+    {
+      finishUpload(*upload.cubemap);
+      _uploads.pop_front();
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
@@ -0,0 +1,129 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <GL/glew.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Cubemap.h"
+#include "KTXFile.h"
+#include "PPMImage.h"
+#include "ThreadPool.h"
+
+// Streams cubemap faces to the GPU a little at a time. Faces (or a baked KTX
+// container with its whole mip chain) are decoded on the worker pool; update()
+// then copies at most a per-frame byte budget of rows into a ring of
+// pixel-unpack buffers and issues glTex(Compressed)SubImage2D from them. Each
+// ring slot is guarded by a fence, and a slot the GPU is still reading from is
+// never waited on: the upload simply continues next frame.
+class TextureStreamer
+{
+public:
+  static const size_t DEFAULT_SLOT_SIZE = 4 * 1024 * 1024;
+  static const unsigned int DEFAULT_SLOT_COUNT = 4;
+  static const size_t DEFAULT_FRAME_BUDGET = 8 * 1024 * 1024;
+
+  TextureStreamer(size_t slotSize = DEFAULT_SLOT_SIZE, unsigned int slotCount = DEFAULT_SLOT_COUNT);
+  ~TextureStreamer();
+
+  TextureStreamer(const TextureStreamer&) = delete;
+  TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+  // Starts loading 'directory' and returns immediately: its baked .ktx when
+  // there is one, otherwise the six PPM faces plus a mip chain generated from
+  // them on the workers. A path naming a single equirectangular .ppm instead is
+  // resampled into six faces of the cubemap's faceSize. The cubemap draws as the
+  // placeholder until every level of every face is on the GPU.
+  std::shared_ptr<Cubemap> load(const std::string& directory);
+  // Same, streaming into a cubemap handle the caller created up front. Also
+  // refills a loaded cubemap: with 'baseLevel' > 0 the top mips are skipped,
+  // and the current texture keeps drawing until the new one is complete.
+  void load(const std::string& directory, std::shared_ptr<Cubemap> cubemap, int baseLevel = 0);
+
+  // The files load() reads for 'directory': the .ktx alone, the six faces, or
+  // the equirectangular image itself
+  static std::vector<std::string> sourcesFor(const std::string& directory);
+
+  // Uploads up to 'budgetBytes' of pending face data. Call once per frame on
+  // the GL thread.
+  void update(size_t budgetBytes = DEFAULT_FRAME_BUDGET);
+
+  // True while anything requested is still decoding or uploading
+  bool busy() const { return _decodesInFlight > 0 || !_uploads.empty(); }
+
+  GLuint placeholder() const { return _placeholder; }
+
+private:
+  // One level of one face, uploaded in bands of rows (of 4x4 blocks when compressed)
+  struct ImageUpload
+  {
+    std::shared_ptr<Cubemap> cubemap;
+    unsigned int face;
+    int level;
+    std::shared_ptr<const void> storage; // keeps 'data' alive
+    const unsigned char* data;
+    int width;
+    int height;
+    GLenum format; // 0 for compressed data
+    GLenum type;
+    size_t rowBytes;
+    int rowCount;
+    int nextRow;
+  };
+
+  // The result of one decode job: a single PPM face and its mips, six faces
+  // resampled from a panorama, or a whole KTX container
+  struct Decoded
+  {
+    std::shared_ptr<Cubemap> cubemap;
+    std::string path;
+    std::string error;
+    GLenum internalFormat;
+    int size;
+    int levels;
+    int baseLevel;
+    KTXCubemap ktx;
+    std::vector<ImageUpload> images;
+  };
+
+  struct Slot
+  {
+    size_t offset;
+    GLsync fence;
+  };
+
+  static Decoded decodeFace(const std::shared_ptr<Cubemap>& cubemap, unsigned int face, const std::string& path,
+                            int baseLevel);
+  static Decoded decodeKTX(const std::shared_ptr<Cubemap>& cubemap, const std::string& path, int baseLevel);
+  static Decoded decodeEquirect(const std::shared_ptr<Cubemap>& cubemap, const std::string& path, int faceSize,
+                                int baseLevel);
+  // Runs 'decode' on the pool and hands its result back through _decoded
+  void submit(std::shared_ptr<Cubemap> cubemap, std::function<Decoded(const std::shared_ptr<Cubemap>&)> decode);
+
+  void createPlaceholder();
+  bool allocate(Cubemap& cubemap, const Decoded& decoded);
+  unsigned char* mapSlot(const Slot& slot);
+  void unmapSlot();
+  void finishDecode(Cubemap& cubemap);
+  void finishUpload(Cubemap& cubemap);
+  void markReady(Cubemap& cubemap);
+
+  // Shared with the jobs, since a worker may still be inside push() after
+  // the destructor's last pop() returns
+  std::shared_ptr<ResultQueue<Decoded>> _decoded{std::make_shared<ResultQueue<Decoded>>()};
+  std::deque<ImageUpload> _uploads;
+  size_t _decodesInFlight{0};
+
+  GLuint _pbo{0};
+  bool _persistent{false};
+  unsigned char* _persistentPtr{nullptr};
+  size_t _slotSize;
+  std::vector<Slot> _slots;
+  unsigned int _nextSlot{0};
+
+  GLuint _placeholder{0};
+};
+
+#endif
@@ -2,89 +2,154 @@
 #include <GL/glew.h>
 #include <iostream>
 #include <vector>
+#include "CubeMesh.h"
+#include "Equirect.h"
+#include "GLState.h"
+#include "KTXFile.h"
+#include "MipGenerator.h"
+#include "PPMImage.h"
+#include "ThreadPool.h"
 
-unsigned char* loadPPM(const char* filename, int& width, int& height)
+namespace
 {
-  const int BUFSIZE = 128;
-  FILE* fp;
-  unsigned int read;
-  unsigned char* rawData;
-  char buf[3][BUFSIZE];
-  char* retval_fgets;
-  size_t retval_sscanf;
+  struct DecodedFace
+  {
+    size_t cubemap;
+    unsigned int face;
+    std::string path;
+    PPMImage image;
+    PPMError error;
+    std::vector<MipLevel> mips;
+  };
+}
+
+std::vector<unsigned int> loadCubemaps(const std::vector<std::string>& directories, const std::vector<std::string>& faces)
+{
+  std::vector<unsigned int> textureIDs(directories.size());
+  glGenTextures((GLsizei)textureIDs.size(), textureIDs.data());
 
-  if ((fp = fopen(filename, "rb")) == NULL)
+  // Map, parse and fault in every face on the worker pool...
+  std::shared_ptr<ResultQueue<DecodedFace>> decoded = std::make_shared<ResultQueue<DecodedFace>>();
+  std::vector<KTXCubemap> containers(directories.size());
+  std::vector<bool> baked(directories.size(), false);
+  std::vector<int> levels(directories.size(), 1);
+  size_t faceCount = 0;
+  for (size_t c = 0; c < directories.size(); c++)
   {
-    std::cerr << "error reading ppm file, could not locate " << filename << std::endl;
-    width = 0;
-    height = 0;
-    return NULL;
-  }
+    // A baked container replaces the loose faces and is already mipmapped
+    if (loadKTX(ktxPathFor(directories[c]), containers[c]) == KTXError::None)
+    {
+      baked[c] = true;
+      continue;
+    }
 
-  // Read magic number:
-  retval_fgets = fgets(buf[0], BUFSIZE, fp);
+    faceCount += faces.size();
+    for (unsigned int i = 0; i < faces.size(); i++)
+    {
+      std::string path = directories[c] + faces[i];
+      ThreadPool::shared().submit([decoded, c, i, path]
+      {
+        DecodedFace result{c, i, path};
+        result.error = decodePPM(path, result.image);
+        if (result.error == PPMError::None)
+        {
+          result.mips = generateMips(result.image.pixels, result.image.width, result.image.height);
+        }
+        decoded->push(std::move(result));
+      });
+    }
+  }
 
-  // Read width and height:
-  do
+  // Baked containers go up while the faces decode...
+  for (size_t c = 0; c < directories.size(); c++)
   {
-    retval_fgets = fgets(buf[0], BUFSIZE, fp);
+    if (baked[c])
+    {
+      glBindTexture(GL_TEXTURE_CUBE_MAP, textureIDs[c]);
+      uploadKTX(containers[c]);
+      containers[c] = KTXCubemap();
+    }
   }
-  while (buf[0][0] == '#');
-  retval_sscanf = sscanf(buf[0], "%s %s", buf[1], buf[2]);
-  width = atoi(buf[1]);
-  height = atoi(buf[2]);
 
-  // Read maxval:
-  do
+  // ...and the faces on this thread in whatever order they finish. Rows of a
+  // mapped PPM are tightly packed RGB triples.
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (size_t n = 0; n < faceCount; n++)
   {
-    retval_fgets = fgets(buf[0], BUFSIZE, fp);
+    DecodedFace face = decoded->pop();
+    glBindTexture(GL_TEXTURE_CUBE_MAP, textureIDs[face.cubemap]);
+    if (face.error == PPMError::None)
+    {
+      // The GL copies straight out of the file mapping, which is released when 'face' goes out of scope
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face.face,
+                   0, GL_RGB, face.image.width, face.image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, face.image.pixels
+      );
+      for (size_t level = 1; level <= face.mips.size(); level++)
+      {
+        const MipLevel& mip = face.mips[level - 1];
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face.face, (GLint)level, GL_RGB, mip.width, mip.height, 0, GL_RGB,
+                     GL_UNSIGNED_BYTE, mip.rgb.data());
+      }
+      levels[face.cubemap] = (int)face.mips.size() + 1;
+    }
+    else
+    {
+      std::cout << "Cubemap texture failed to load at path: " << face.path << " (" << describe(face.error) << ")" << std::endl;
+    }
   }
-  while (buf[0][0] == '#');
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-  // Read image data:
-  rawData = new unsigned char[width * height * 3];
-  read = fread(rawData, width * height * 3, 1, fp);
-  fclose(fp);
-  if (read != 1)
+  for (size_t c = 0; c < directories.size(); c++)
   {
-    std::cerr << "error parsing ppm file, incomplete data" << std::endl;
-    delete[] rawData;
-    width = 0;
-    height = 0;
-    return NULL;
+    if (!baked[c])
+    {
+      glBindTexture(GL_TEXTURE_CUBE_MAP, textureIDs[c]);
+      setCubemapParameters(levels[c]);
+    }
   }
 
-  return rawData;
+  return textureIDs;
 }
 
 unsigned loadCubemap(const std::string directory, std::vector<std::string>& faces)
+{
+  return loadCubemaps(std::vector<std::string>{directory}, faces)[0];
+}
+
+unsigned loadEquirectCubemap(const std::string path, int faceSize)
 {
   unsigned int textureID;
   glGenTextures(1, &textureID);
   glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-  int width, height;
-  for (unsigned int i = 0; i < faces.size(); i++)
+  PPMImage image;
+  PPMError error = decodePPM(path, image);
+  if (error != PPMError::None)
   {
-    std::string path = directory + faces[i];
-    unsigned char* data = loadPPM(path.c_str(), width, height);
-    if (data)
-    {
-      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                   0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
-      );
-    }
-    else
+    std::cout << "Cubemap texture failed to load at path: " << path << " (" << describe(error) << ")" << std::endl;
+    return textureID;
+  }
+
+  int size = faceSize > 0 ? faceSize : defaultFaceSize(image.width);
+  std::vector<unsigned char> faces[6];
+  std::vector<MipLevel> mips[6];
+  equirectToCubemap(image.pixels, image.width, image.height, size, faces);
+  parallelFor(6, [&](size_t face) { mips[face] = generateMips(faces[face].data(), size, size); });
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (unsigned int face = 0; face < 6; face++)
+  {
+    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB, size, size, 0, GL_RGB, GL_UNSIGNED_BYTE,
+                 faces[face].data());
+    for (size_t level = 1; level <= mips[face].size(); level++)
     {
-      std::cout << "Cubemap texture failed to load at path: " << faces[i].c_str() << std::endl;
+      const MipLevel& mip = mips[face][level - 1];
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, (GLint)level, GL_RGB, mip.width, mip.height, 0, GL_RGB,
+                   GL_UNSIGNED_BYTE, mip.rgb.data());
     }
   }
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  setCubemapParameters((int)mips[0].size() + 1);
   return textureID;
 }
 
@@ -98,33 +163,212 @@ std::vector<std::string> faces
   "front.ppm"
 };
 
-TexturedCube::TexturedCube(const std::string dir) : Cube()
+TexturedCube::TexturedCube(const std::string dir, int faceSize) : Cube()
+{
+  if (isEquirectangular(dir))
+  {
+    cubeMap.reset(Cubemap::fromTexture(loadEquirectCubemap("./" + dir, faceSize)));
+  }
+  else
+  {
+    cubeMap.reset(Cubemap::fromTexture(loadCubemap("./" + dir + "/", faces)));
+  }
+}
+
+TexturedCube::TexturedCube(std::shared_ptr<Cubemap> cubeMap) : Cube(), cubeMap(cubeMap)
 {
-  cubeMap = loadCubemap("./" + dir + "/", faces);
 }
 
 TexturedCube::~TexturedCube()
 {
-  glDeleteTextures(1, &cubeMap);
+  glDeleteBuffers(1, &instanceBuffer);
 }
 
-void TexturedCube::draw(unsigned shader, const glm::mat4& p, const glm::mat4& v)
+void TexturedCube::bindState(unsigned shader)
 {
-  glUseProgram(shader);
-  // ... set view and projection matrix
-  uProjection = glGetUniformLocation(shader, "projection");
-  uView = glGetUniformLocation(shader, "view");
+  GLState& state = GLState::shared();
+  state.setEnabled(GL_CULL_FACE, cullFace != 0);
+  if (cullFace)
+  {
+    state.cullFace(cullFace);
+  }
+  state.depthMask(depthWrite);
+  state.depthFunc(depthFunc);
+  state.useProgram(shader);
+  state.bindVertexArray(VAO);
+  state.bindTexture(0, GL_TEXTURE_CUBE_MAP, cubeMap->textureForDraw());
+}
 
-  glm::mat4 modelview = v * toWorld;
+void TexturedCube::bind(unsigned shader, const glm::mat4& p, const glm::mat4& modelview)
+{
+  bindState(shader);
+  setUniforms(shader, p, modelview);
+}
+
+void TexturedCube::setUniforms(unsigned shader, const glm::mat4& p, const glm::mat4& modelview)
+{
+  // ... set view and projection matrix, looked up the first time this program is used
+  if (uniformProgram != shader)
+  {
+    const ProgramReflection& reflection = ProgramReflection::of(shader);
+    uProjection = reflection.mat4("projection");
+    uView = reflection.mat4("view");
+    uSkybox = reflection.sampler("skybox", GL_SAMPLER_CUBE);
+    uniformProgram = shader;
+  }
 
   // Now send these values to the shader program
-  glUniformMatrix4fv(uProjection, 1, GL_FALSE, &p[0][0]);
-  glUniformMatrix4fv(uView, 1, GL_FALSE, &modelview[0][0]);
-
-  glBindVertexArray(VAO);
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
-  glUniform1i(glGetUniformLocation(shader, "skybox"), 0);
-  glDrawArrays(GL_TRIANGLES, 0, 36);
-  glBindVertexArray(0);
+  uProjection.set(p);
+  uView.set(modelview);
+  uSkybox.set(0);
+}
+
+ProgramInterface TexturedCube::instancedInterface(bool stereo, GLuint attribute)
+{
+  ProgramInterface expected;
+  expected.uniforms.push_back({"skybox", GL_SAMPLER_CUBE});
+  if (stereo)
+  {
+    expected.blocks.push_back("StereoEyes");
+  }
+  else
+  {
+    expected.uniforms.push_back({"projection", GL_FLOAT_MAT4});
+    expected.uniforms.push_back({"view", GL_FLOAT_MAT4});
+  }
+  // CubeMesh feeds positions to slot 0
+  expected.attributes.push_back({"position", 0});
+  expected.attributes.push_back({"instanceTransform", (GLint)attribute});
+  return expected;
+}
+
+void TexturedCube::setInstanceDivisor(GLuint divisor)
+{
+  if (divisor == instanceDivisor)
+  {
+    return;
+  }
+  instanceDivisor = divisor;
+  for (GLuint column = 0; column < 4; column++)
+  {
+    glVertexAttribDivisor(instanceAttribute + column, divisor);
+  }
+}
+
+void TexturedCube::draw(unsigned shader, const glm::mat4& p, const glm::mat4& v)
+{
+  bind(shader, p, v * toWorld);
+  glDrawElements(GL_TRIANGLES, CubeMesh::shared().indexCount(), GL_UNSIGNED_SHORT, (GLvoid*)0);
+}
+
+void TexturedCube::setInstances(const std::vector<glm::mat4>& transforms, GLuint attribute)
+{
+  GLState::shared().bindVertexArray(VAO);
+  if (!instanceBuffer)
+  {
+    glGenBuffers(1, &instanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    // A mat4 attribute is its four columns in consecutive slots, each stepped once per instance
+    instanceAttribute = attribute;
+    for (GLuint column = 0; column < 4; column++)
+    {
+      glEnableVertexAttribArray(attribute + column);
+      glVertexAttribPointer(attribute + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                            (GLvoid*)(sizeof(glm::vec4) * column));
+    }
+    setInstanceDivisor(1);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+  // Respecifying the whole store orphans the old one, so this doesn't wait on draws still reading it
+  glBufferData(GL_ARRAY_BUFFER, transforms.size() * sizeof(glm::mat4), transforms.data(), GL_STREAM_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  instanceCount = (GLsizei)transforms.size();
+
+  instanceCenter = glm::vec3(0.0f);
+  for (const glm::mat4& transform : transforms)
+  {
+    instanceCenter = instanceCenter + glm::vec3(transform[3]) / (float)transforms.size();
+  }
+}
+
+void TexturedCube::drawInstanced(unsigned shader, const glm::mat4& p, const glm::mat4& v)
+{
+  if (!instanceCount)
+  {
+    return;
+  }
+  bind(shader, p, v);
+  setInstanceDivisor(1);
+  glDrawElementsInstanced(GL_TRIANGLES, CubeMesh::shared().indexCount(), GL_UNSIGNED_SHORT, (GLvoid*)0, instanceCount);
+}
+
+void TexturedCube::drawStereoInstanced(unsigned shader, StereoPass& stereo)
+{
+  if (!instanceCount)
+  {
+    return;
+  }
+  bindState(shader);
+  if (stereoProgram != shader)
+  {
+    uStereoSkybox = ProgramReflection::of(shader).sampler("skybox", GL_SAMPLER_CUBE);
+    stereoProgram = shader;
+  }
+  stereo.bind(shader);
+  uStereoSkybox.set(0);
+  // Side by side, each cube is drawn as an adjacent left/right pair of instances
+  GLsizei perCube = stereo.instancesPerObject();
+  setInstanceDivisor(perCube);
+  glDrawElementsInstanced(GL_TRIANGLES, CubeMesh::shared().indexCount(), GL_UNSIGNED_SHORT, (GLvoid*)0,
+                          instanceCount * perCube);
+}
+
+DrawPacket TexturedCube::basePacket(unsigned shader, unsigned eyes)
+{
+  DrawPacket packet;
+  packet.eyes = eyes;
+  packet.program = shader;
+  packet.vertexArray = VAO;
+  packet.textures[0] = cubeMap->textureForDraw();
+  packet.cullFace = cullFace;
+  packet.depthWrite = depthWrite;
+  packet.depthFunc = depthFunc;
+  packet.object = this;
+  return packet;
+}
+
+DrawPacket TexturedCube::packet(unsigned shader, unsigned eyes)
+{
+  DrawPacket packet = basePacket(shader, eyes);
+  packet.position = glm::vec3(toWorld[3]);
+  packet.draw = drawPacket;
+  return packet;
+}
+
+DrawPacket TexturedCube::instancedPacket(unsigned shader, unsigned eyes)
+{
+  DrawPacket packet = basePacket(shader, eyes);
+  packet.position = instanceCenter;
+  packet.draw = drawInstancedPacket;
+  return packet;
+}
+
+void TexturedCube::drawPacket(const DrawPacket& packet, const glm::mat4& p, const glm::mat4& v)
+{
+  TexturedCube* cube = static_cast<TexturedCube*>(packet.object);
+  cube->setUniforms(packet.program, p, v * cube->toWorld);
+  glDrawElements(GL_TRIANGLES, CubeMesh::shared().indexCount(), GL_UNSIGNED_SHORT, (GLvoid*)0);
+}
+
+void TexturedCube::drawInstancedPacket(const DrawPacket& packet, const glm::mat4& p, const glm::mat4& v)
+{
+  TexturedCube* cube = static_cast<TexturedCube*>(packet.object);
+  if (!cube->instanceCount)
+  {
+    return;
+  }
+  cube->setUniforms(packet.program, p, v);
+  cube->setInstanceDivisor(1);
+  glDrawElementsInstanced(GL_TRIANGLES, CubeMesh::shared().indexCount(), GL_UNSIGNED_SHORT, (GLvoid*)0,
+                          cube->instanceCount);
 }
@@ -2,19 +2,84 @@
 #define TEXTUREDCUBE_H
 
 #include "Cube.h"
+#include "Cubemap.h"
+#include "RenderQueue.h"
+#include "StereoPass.h"
+#include <memory>
 #include <string>
+#include <vector>
 
 class TexturedCube : public Cube
 {
 public:
 
-  TexturedCube(const std::string dir);
+  // 'dir' holds the six faces, or names an equirectangular .ppm that is
+  // resampled to 'faceSize' (0 for defaultFaceSize)
+  TexturedCube(const std::string dir, int faceSize = 0);
+  // Draws with a cubemap that may still be streaming in
+  explicit TexturedCube(std::shared_ptr<Cubemap> cubeMap);
   ~TexturedCube();
 
   void draw(unsigned int shader, const glm::mat4& p, const glm::mat4& v);
 
+  // Uploads one model transform per instance into the mat4 attribute starting
+  // at slot 'attribute' (a mat4 takes four consecutive slots)
+  void setInstances(const std::vector<glm::mat4>& transforms, GLuint attribute);
+  // Every instance from setInstances in one draw call, with a program built
+  // with INSTANCED. toWorld is not used.
+  void drawInstanced(unsigned int shader, const glm::mat4& p, const glm::mat4& v);
+  // drawInstanced for both eyes at once, inside stereo.begin() and end(), with
+  // a program built with INSTANCED and STEREO (or MULTIVIEW)
+  void drawStereoInstanced(unsigned int shader, StereoPass& stereo);
+
+  // draw() and drawInstanced() as RenderQueue packets for 'eyes', with the
+  // cubemap textureForDraw() gives now. The cube must outlive the frame.
+  DrawPacket packet(unsigned int shader, unsigned int eyes);
+  DrawPacket instancedPacket(unsigned int shader, unsigned int eyes);
+
+  // What an instanced program must have for drawInstanced(), or with 'stereo'
+  // for drawStereoInstanced(), given setInstances' 'attribute'
+  static ProgramInterface instancedInterface(bool stereo, GLuint attribute);
+
+  // Rasterizer state of this cube's draws (cullFace 0 draws both sides).
+  // Cubes are looked at from outside, which, with the mesh wound to be seen
+  // from inside, culls the front faces.
+  GLenum cullFace{GL_FRONT};
+  GLboolean depthWrite{GL_TRUE};
+  GLenum depthFunc{GL_LESS};
+
   // These variables are needed for the shader program
-  unsigned int cubeMap;
-  unsigned int uProjection, uView;
+  std::shared_ptr<Cubemap> cubeMap;
+  // Resolved once for the program in Cube::uniformProgram
+  UniformHandle<glm::mat4> uProjection, uView;
+  UniformHandle<GLint> uSkybox;
+  GLuint instanceBuffer{0};
+  GLuint instanceAttribute{0};
+  GLuint instanceDivisor{0};
+  GLsizei instanceCount{0};
+  // Where the instances are, on average, for the depth order
+  glm::vec3 instanceCenter;
+  // The stereo program takes its matrices from StereoPass, so only the sampler is resolved for it
+  GLuint stereoProgram{0};
+  UniformHandle<GLint> uStereoSkybox;
+
+protected:
+  // Makes 'shader' current with this cube's rasterizer state, its vertex
+  // array and the cubemap bound to unit 0
+  void bindState(unsigned int shader);
+  // Sets the uniforms of 'shader', which is current with the cubemap bound to unit 0
+  void setUniforms(unsigned int shader, const glm::mat4& p, const glm::mat4& modelview);
+  // The state bind() sets, as packet fields
+  DrawPacket basePacket(unsigned int shader, unsigned int eyes);
+
+private:
+  // What the queue calls for packet() and instancedPacket()
+  static void drawPacket(const DrawPacket& packet, const glm::mat4& p, const glm::mat4& v);
+  static void drawInstancedPacket(const DrawPacket& packet, const glm::mat4& p, const glm::mat4& v);
+
+  // Makes 'shader' current with its uniforms set and the cubemap bound to unit 0
+  void bind(unsigned int shader, const glm::mat4& p, const glm::mat4& modelview);
+  // Steps the instance transform once every 'divisor' instances
+  void setInstanceDivisor(GLuint divisor);
 };
 #endif
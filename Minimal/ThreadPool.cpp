@@ -0,0 +1,124 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include "CpuProfiler.h"
+
+ThreadPool::ThreadPool(unsigned int threads)
+{
+  if (threads == 0)
+  {
+    unsigned int hardware = std::thread::hardware_concurrency();
+    threads = hardware > 1 ? hardware - 1 : 1;
+  }
+
+  for (unsigned int i = 0; i < threads; i++)
+  {
+    _workers.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _wake.notify_all();
+  for (std::thread& worker : _workers)
+  {
+    worker.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> job)
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _jobs.push_back(std::move(job));
+  }
+  _wake.notify_one();
+}
+
+ThreadPool& ThreadPool::shared()
+{
+  static ThreadPool pool;
+  return pool;
+}
+
+void ThreadPool::workerLoop()
+{
+  PROFILE_THREAD("worker");
+  for (;;)
+  {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _wake.wait(lock, [this] { return _stopping || !_jobs.empty(); });
+      if (_stopping && _jobs.empty())
+      {
+        return;
+      }
+      job = std::move(_jobs.front());
+      _jobs.pop_front();
+    }
+    PROFILE_ZONE("job");
+    job();
+  }
+}
+
+namespace
+{
+  struct ParallelForState
+  {
+    std::function<void(size_t)> body;
+    size_t count;
+    std::atomic<size_t> next{0};
+    size_t finished{0};
+    std::mutex mutex;
+    std::condition_variable done;
+
+    // Claims indices until none are left
+    void run()
+    {
+      size_t ran = 0;
+      for (size_t i = next++; i < count; i = next++)
+      {
+        body(i);
+        ++ran;
+      }
+      if (ran)
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished += ran;
+        if (finished == count)
+        {
+          done.notify_all();
+        }
+      }
+    }
+  };
+}
+
+void parallelFor(size_t count, const std::function<void(size_t)>& body)
+{
+  if (count == 0)
+  {
+    return;
+  }
+
+  std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+  state->body = body;
+  state->count = count;
+
+  size_t helpers = std::min<size_t>(count - 1, ThreadPool::shared().size());
+  for (size_t i = 0; i < helpers; i++)
+  {
+    ThreadPool::shared().submit([state] { state->run(); });
+  }
+  state->run();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->done.wait(lock, [&] { return state->finished == state->count; });
+}
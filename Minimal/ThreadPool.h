@@ -0,0 +1,87 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads pulling jobs from a shared FIFO. Jobs must not
+// touch the GL; results that need the context are handed back to the render
+// thread through a ResultQueue.
+class ThreadPool
+{
+public:
+  // 0 picks one worker per hardware thread, leaving one for the render thread
+  explicit ThreadPool(unsigned int threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void submit(std::function<void()> job);
+  unsigned int size() const { return (unsigned int)_workers.size(); }
+
+  // The process-wide pool used by asset loading
+  static ThreadPool& shared();
+
+private:
+  void workerLoop();
+
+  std::vector<std::thread> _workers;
+  std::deque<std::function<void()>> _jobs;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  bool _stopping{false};
+};
+
+// Runs body(i) for every i in [0, count) on the shared pool and returns once
+// all of them have finished. The calling thread takes part in the work, so
+// this may also be called from inside a pool job.
+void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+// Multi-producer, single-consumer queue of finished job results, popped in the
+// order the jobs completed.
+template <typename T>
+class ResultQueue
+{
+public:
+  void push(T value)
+  {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _results.push_back(std::move(value));
+    }
+    _ready.notify_one();
+  }
+
+  T pop()
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _ready.wait(lock, [this] { return !_results.empty(); });
+    T value = std::move(_results.front());
+    _results.pop_front();
+    return value;
+  }
+
+  bool tryPop(T& value)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_results.empty())
+    {
+      return false;
+    }
+    value = std::move(_results.front());
+    _results.pop_front();
+    return true;
+  }
+
+private:
+  std::deque<T> _results;
+  std::mutex _mutex;
+  std::condition_variable _ready;
+};
+
+#endif
@@ -21,6 +21,7 @@ limitations under the License.
 #include <memory>
 #include <exception>
 #include <algorithm>
+#include <iterator>
 
 #include <Windows.h>
 
@@ -42,6 +43,11 @@ limitations under the License.
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include "Skybox.h"
+#include "GLState.h"
+#include "Multiview.h"
+#include "StereoPass.h"
+#include "GpuProfiler.h"
+#include "CpuProfiler.h"
 
 // Import the most commonly used types into the default namespace
 using glm::ivec3;
@@ -225,13 +231,27 @@ public:
 
     initGl();
 
+    PROFILE_THREAD("render");
     while (!glfwWindowShouldClose(window))
     {
       ++frame;
-      glfwPollEvents();
-      update();
-      draw();
-      finishFrame();
+      PROFILE_FRAME(frame);
+      {
+        PROFILE_ZONE("glfwPollEvents");
+        glfwPollEvents();
+      }
+      {
+        PROFILE_ZONE("update");
+        update();
+      }
+      {
+        PROFILE_ZONE("draw");
+        draw();
+      }
+      {
+        PROFILE_ZONE("finishFrame");
+        finishFrame();
+      }
     }
 
     shutdownGl();
@@ -313,6 +333,17 @@ protected:
     case GLFW_KEY_ESCAPE:
       glfwSetWindowShouldClose(window, 1);
       return;
+
+    case GLFW_KEY_P:
+      if (CpuProfiler::writeTrace("cpu_trace.json"))
+      {
+        std::cout << "Wrote cpu_trace.json" << std::endl;
+      }
+      else
+      {
+        std::cerr << "Could not write cpu_trace.json" << std::endl;
+      }
+      return;
     }
   }
 
@@ -504,6 +535,13 @@ private:
   uvec2 _renderTargetSize;
   uvec2 _mirrorSize;
 
+  // Both eyes drawn in one pass (toggled with S)
+  bool _singlePassStereo{false};
+  bool _gpuOverlay{false};
+  // Set when that pass renders into layers with OVR_multiview2
+  bool _multiviewRequested{false};
+  std::unique_ptr<MultiviewTarget> _multiview;
+
 public:
 
   RiftApp()
@@ -540,6 +578,13 @@ public:
     _mirrorSize /= 4;
   }
 
+  // Asks for the OVR_multiview2 path; call before run(). Falls back to side by
+  // side drawing when the driver doesn't have it.
+  void requestMultiview(bool multiview)
+  {
+    _multiviewRequested = multiview;
+  }
+
   void setIOD(float iodOffset) {
 	   float newIOD = iod + iodOffset;
 	
@@ -621,6 +666,33 @@ protected:
       FAIL("Could not create mirror texture");
     }
     glGenFramebuffers(1, &_mirrorFbo);
+
+    if (_multiviewRequested)
+    {
+      if (multiviewSupported())
+      {
+        // One layer per eye, large enough for either
+        const auto& left = _sceneLayer.Viewport[0].Size;
+        const auto& right = _sceneLayer.Viewport[1].Size;
+        _multiview = std::make_unique<MultiviewTarget>(std::max(left.w, right.w), std::max(left.h, right.h));
+        if (!_multiview->valid())
+        {
+          _multiview.reset();
+        }
+      }
+      std::cout << (_multiview ? "Rendering both eyes with OVR_multiview2" : "OVR_multiview2 is not available, rendering both eyes side by side") << std::endl;
+      _singlePassStereo = true;
+    }
+  }
+
+  void shutdownGl() override
+  {
+    _multiview.reset();
+  }
+
+  bool usingMultiview() const
+  {
+    return _multiview != nullptr;
   }
 
   void onKey(int key, int scancode, int action, int mods) override
@@ -631,6 +703,38 @@ protected:
       case GLFW_KEY_R:
         ovr_RecenterTrackingOrigin(_session);
         return;
+
+      case GLFW_KEY_G:
+      {
+        GLState::Stats stats = GLState::shared().lastFrame();
+        std::cout << "GL state: " << stats.issued << " calls issued, " << stats.elided << " elided last frame" << std::endl;
+        return;
+      }
+
+      case GLFW_KEY_S:
+        _singlePassStereo = !_singlePassStereo;
+        std::cout << (_singlePassStereo ? "Single-pass" : "Multi-pass") << " stereo" << std::endl;
+        return;
+
+      case GLFW_KEY_T:
+        _gpuOverlay = !_gpuOverlay;
+        return;
+
+      case GLFW_KEY_C:
+      {
+        GpuProfiler& gpu = GpuProfiler::shared();
+        for (const GpuProfiler::ScopeStats& stats : gpu.stats())
+        {
+          std::cout << "GPU " << stats.name << ": " << stats.meanMs << " ms mean (" << stats.minMs << " - " << stats.maxMs
+                    << ") over " << stats.samples << " frames" << std::endl;
+        }
+        std::cout << gpu.dropped() << " frames dropped" << std::endl;
+        if (!gpu.writeCSV("gpu_timings.csv"))
+        {
+          std::cerr << "Could not write gpu_timings.csv" << std::endl;
+        }
+        return;
+      }
       }
 
     GlfwApp::onKey(key, scancode, action, mods);
@@ -638,15 +742,27 @@ protected:
 
   void draw() final override
   {
+    // The loaders and the SDK have used the context since the last frame
+    GLState& state = GLState::shared();
+    state.beginFrame();
+    GpuProfiler& gpu = GpuProfiler::shared();
+    gpu.beginFrame();
+    gpu.begin("frame");
+
     ovrPosef eyePoses[2];
-    ovr_GetEyePoses(_session, frame, true, _viewScaleDesc.HmdToEyePose, eyePoses, &_sceneLayer.SensorSampleTime);
+    {
+      PROFILE_ZONE("ovr_GetEyePoses");
+      ovr_GetEyePoses(_session, frame, true, _viewScaleDesc.HmdToEyePose, eyePoses, &_sceneLayer.SensorSampleTime);
+    }
 
     int curIndex;
     ovr_GetTextureSwapChainCurrentIndex(_session, _eyeTexture, &curIndex);
     GLuint curTexId;
     ovr_GetTextureSwapChainBufferGL(_session, _eyeTexture, curIndex, &curTexId);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
+    state.bindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
     glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, curTexId, 0);
+    // The skybox leaves depth writes off, and clearing obeys the depth mask
+    state.depthMask(GL_TRUE);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	if (OVR_SUCCESS(ovr_GetInputState(_session, ovrControllerType_Touch, &inputState)))
@@ -663,37 +779,55 @@ protected:
 		}
 
 		if (a_pressed == 0) {
-			ovr::for_each_eye([&](ovrEyeType eye)
-			{
-				const auto& vp = _sceneLayer.Viewport[eye];
-				glViewport(vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
-				_sceneLayer.RenderPose[eye] = eyePoses[eye];
-				renderScene(_eyeProjections[eye], ovr::toGlm(eyePoses[eye]), eye);
-			});
+			if (_singlePassStereo) {
+				renderBothEyes(eyePoses, false);
+			}
+			else {
+				ovr::for_each_eye([&](ovrEyeType eye)
+				{
+					const auto& vp = _sceneLayer.Viewport[eye];
+					state.viewport(vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
+					_sceneLayer.RenderPose[eye] = eyePoses[eye];
+					GpuScope eyeScope(eye == ovrEye_Left ? "left eye" : "right eye");
+					PROFILE_ZONE("renderScene");
+					renderScene(_eyeProjections[eye], ovr::toGlm(eyePoses[eye]), eye);
+				});
+			}
 		}
 
 		if (a_pressed == 1) {
 			const auto& vp = _sceneLayer.Viewport[0];
-			glViewport(vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
+			state.viewport(vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
 			_sceneLayer.RenderPose[0] = eyePoses[0];
+			GpuScope eyeScope("left eye");
+			PROFILE_ZONE("renderScene");
 			renderScene(_eyeProjections[0], ovr::toGlm(eyePoses[0]), 0);
 		}
 
 		if (a_pressed == 2) {
 			const auto& vp = _sceneLayer.Viewport[1];
-			glViewport(vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
+			state.viewport(vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
 			_sceneLayer.RenderPose[1] = eyePoses[1];
+			GpuScope eyeScope("right eye");
+			PROFILE_ZONE("renderScene");
 			renderScene(_eyeProjections[1], ovr::toGlm(eyePoses[1]), 1);
 		}
 
 		if (a_pressed == 3) {
-			ovr::for_each_eye([&](ovrEyeType eye)
-			{
-				const auto& vp = _sceneLayer.Viewport[eye];
-				glViewport(vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
-				_sceneLayer.RenderPose[eye] = eyePoses[eye];
-				renderScene(_eyeProjections[eye], ovr::toGlm(eyePoses[eye]), 1-eye);
-			});
+			if (_singlePassStereo) {
+				renderBothEyes(eyePoses, true);
+			}
+			else {
+				ovr::for_each_eye([&](ovrEyeType eye)
+				{
+					const auto& vp = _sceneLayer.Viewport[eye];
+					state.viewport(vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
+					_sceneLayer.RenderPose[eye] = eyePoses[eye];
+					GpuScope eyeScope(eye == ovrEye_Left ? "left eye" : "right eye");
+					PROFILE_ZONE("renderScene");
+					renderScene(_eyeProjections[eye], ovr::toGlm(eyePoses[eye]), 1-eye);
+				});
+			}
 		}
 
 		if (!(inputState.Buttons & ovrButton_A) & a_hasPressed) {
@@ -703,21 +837,85 @@ protected:
 	}
 
     glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    state.bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
     ovr_CommitTextureSwapChain(_session, _eyeTexture);
     ovrLayerHeader* headerList = &_sceneLayer.Header;
-    ovr_SubmitFrame(_session, frame, &_viewScaleDesc, &headerList, 1);
+    {
+      PROFILE_ZONE("ovr_SubmitFrame");
+      ovr_SubmitFrame(_session, frame, &_viewScaleDesc, &headerList, 1);
+    }
+    state.invalidate();
 
     GLuint mirrorTextureId;
     ovr_GetMirrorTextureBufferGL(_session, _mirrorTexture, &mirrorTextureId);
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, _mirrorFbo);
+    state.bindFramebuffer(GL_READ_FRAMEBUFFER, _mirrorFbo);
     glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mirrorTextureId, 0);
+    gpu.begin("mirror blit");
     glBlitFramebuffer(0, 0, _mirrorSize.x, _mirrorSize.y, 0, _mirrorSize.y, _mirrorSize.x, 0, GL_COLOR_BUFFER_BIT,
                       GL_NEAREST);
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    gpu.end();
+    state.bindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    gpu.end(); // frame
+    gpu.endFrame();
+
+    if (_gpuOverlay)
+    {
+      // On the mirror only; the bars are drawn with scissored clears, which the state cache doesn't track
+      gpu.drawOverlay(_mirrorSize.x, _mirrorSize.y, 1000.0 / _hmdDesc.DisplayRefreshRate);
+      state.invalidate();
+    }
+  }
+
+  // Hands both eyes to renderStereoScene; 'swapEyes' draws each eye's content into the other's viewport
+  void renderBothEyes(const ovrPosef eyePoses[2], bool swapEyes)
+  {
+    glm::mat4 headPoses[2];
+    glm::vec4 viewports[2], layerViewports[2];
+    int whichEyes[2];
+    ovr::for_each_eye([&](ovrEyeType eye)
+    {
+      const auto& vp = _sceneLayer.Viewport[eye];
+      viewports[eye] = glm::vec4((float)vp.Pos.x, (float)vp.Pos.y, (float)vp.Size.w, (float)vp.Size.h);
+      layerViewports[eye] = glm::vec4(0.0f, 0.0f, (float)vp.Size.w, (float)vp.Size.h);
+      _sceneLayer.RenderPose[eye] = eyePoses[eye];
+      headPoses[eye] = ovr::toGlm(eyePoses[eye]);
+      whichEyes[eye] = swapEyes ? 1 - eye : eye;
+    });
+
+    GpuScope bothEyes("both eyes");
+    PROFILE_ZONE("renderStereoScene");
+    if (!_multiview)
+    {
+      renderStereoScene(_eyeProjections, headPoses, whichEyes, viewports, _renderTargetSize, nullptr);
+      return;
+    }
+    // Each eye is drawn at the origin of its own layer, then copied into its half of the swap chain texture
+    _multiview->clear();
+    uvec2 layerSize(std::max(viewports[0].z, viewports[1].z), std::max(viewports[0].w, viewports[1].w));
+    renderStereoScene(_eyeProjections, headPoses, whichEyes, layerViewports, layerSize, _multiview.get());
+    _multiview->resolve(_fbo, viewports);
   }
 
   virtual void renderScene(const glm::mat4& projection, const glm::mat4& headPose, const int whichEye) = 0;
+
+  // Both eyes at once; viewports are x, y, width, height within the render
+  // target, or within each eye's layer of 'multiview' when that is set.
+  // Unless overridden, simply renders each eye in turn.
+  virtual void renderStereoScene(const glm::mat4 projections[2], const glm::mat4 headPoses[2], const int whichEyes[2],
+                                 const glm::vec4 viewports[2], const uvec2& targetSize, MultiviewTarget* multiview)
+  {
+    for (int eye = 0; eye < 2; eye++)
+    {
+      if (multiview)
+      {
+        multiview->bindEye(eye);
+      }
+      GLState::shared().viewport((GLint)viewports[eye].x, (GLint)viewports[eye].y, (GLsizei)viewports[eye].z,
+                                 (GLsizei)viewports[eye].w);
+      PROFILE_ZONE("renderScene");
+      renderScene(projections[eye], headPoses[eye], whichEyes[eye]);
+    }
+  }
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -750,6 +948,16 @@ protected:
 #include <vector>
 #include "shader.h"
 #include "Cube.h"
+#include "AssetPack.h"
+#include "Bench.h"
+#include "TextureBaker.h"
+#include "ModePrefetcher.h"
+#include "ShaderVariants.h"
+#include "ResidencyManager.h"
+#include "TextureCache.h"
+#include "RenderQueue.h"
+#include "Culling.h"
+#include "ProgramCache.h"
 
 namespace Attribute {
 	enum {
@@ -762,36 +970,6 @@ namespace Attribute {
 	};
 }
 
-static const char * VERTEX_SHADER = R"SHADER(
-#version 410 core
-
-uniform mat4 ProjectionMatrix = mat4(1);
-uniform mat4 ViewMatrix = mat4(1);
-uniform mat4 ModelMatrix = mat4(1);
-
-layout(location = 0) in vec4 Position;
-layout(location = 1) in vec3 Normal;
-
-out vec3 vertNormal;
-
-void main(void) {
-   vertNormal = Normal;
-   gl_Position = ProjectionMatrix * ViewMatrix * ModelMatrix * Position;
-}
-)SHADER";
-
-static const char * FRAGMENT_SHADER = R"SHADER(
-#version 410 core
-
-uniform vec4 color = vec4(1);
-in vec3 vertNormal;
-out vec4 fragColor;
-
-void main(void) {
-    fragColor = color;
-}
-)SHADER";
-
 
 using namespace oglplus;
 // a class for encapsulating building and rendering an RGB cube
@@ -801,7 +979,28 @@ class Scene
   // Program
   std::vector<glm::mat4> instance_positions;
   GLuint instanceCount;
-  GLuint shaderID;
+  GLuint shaderID{0};
+  GLuint rightSkyboxShaderID{0};
+  GLuint cubeShaderID{0};
+  GLuint stereoCubeShaderID{0};
+  GLuint multiviewCubeShaderID{0};
+  std::unique_ptr<ShaderVariants> cubeShaders;
+  // Only built when the app renders with OVR_multiview2
+  std::unique_ptr<ShaderVariants> multiviewCubeShaders;
+  // Set once every program above has been checked against what the C++ side sets
+  bool programsVerified{false};
+  StereoPass stereo;
+  // The cube scale the instance transforms and bounds were last computed for
+  float instancedCubeScale{-1.0f};
+  std::vector<glm::mat4> instanceTransforms;
+  // The instances in the instance buffer, as indices into instanceTransforms
+  std::vector<uint32_t> uploadedInstances;
+  bool instancesChanged{true};
+  std::unique_ptr<ShaderVariants> skyboxShaders;
+  std::shared_ptr<PendingProgram> sphereProgram;
+  GLuint sphereUniformProgram{0};
+  UniformHandle<glm::mat4> uSphereModel;
+  UniformHandle<glm::vec4> uSphereColor;
 
   std::unique_ptr<TexturedCube> cube;
   std::unique_ptr<Skybox> skybox;
@@ -811,6 +1010,17 @@ class Scene
 
   glm::mat4 drawView;
 
+  // This frame's draws, built by the first eye and replayed by both
+  RenderQueue queue;
+  unsigned int queuedFrame{0};
+  mat4 cursorModel;
+
+  // Bounds of the cube instances (indices 0 to instanceCount - 1) and the
+  // cursor, and what each eye was last found to see of them
+  CullSet bounds;
+  uint32_t cursorBounds{0};
+  std::vector<uint32_t> visible[2];
+
   //for render sphere
   Program prog;
   shapes::Sphere makeSphere;
@@ -824,30 +1034,32 @@ class Scene
   std::vector<vec3> sphereLocs;
 
 public:
-	Scene() : sphereInstr(makeSphere.Instructions()), sphereIndices(makeSphere.Indices())
+	Scene(TextureCache& textures, bool multiview) : sphereInstr(makeSphere.Instructions()), sphereIndices(makeSphere.Indices())
 	{
 
-		try {
-			// attach the shaders to the program
-			prog.AttachShader(
-				FragmentShader()
-				.Source(GLSLSource(String(FRAGMENT_SHADER)))
-				.Compile()
-			);
-			prog.AttachShader(
-				VertexShader()
-				.Source(GLSLSource(String(VERTEX_SHADER)))
-				.Compile()
-			);
-			prog.Link();
+		// Every program goes to the driver up front and is only waited on when
+		// first drawn, so they compile while the textures load. The sphere
+		// program is built into the name oglplus wraps.
+		std::string sphereVertex, sphereFragment, error;
+		std::vector<std::string> sphereFiles;
+		if (!expandIncludes("sphere.vert", sphereVertex, sphereFiles, error) ||
+			!expandIncludes("sphere.frag", sphereFragment, sphereFiles, error)) {
+			FAIL(error.c_str());
 		}
-		catch (ProgramBuildError & err) {
-			FAIL((const char*)err.what());
+		sphereProgram = SubmitProgram("sphere",
+			{ { GL_VERTEX_SHADER, sphereVertex }, { GL_FRAGMENT_SHADER, sphereFragment } }, GetGLName(prog));
+		// The residual right eye gets its own specialization; the others don't
+		// carry its sampling. The cubes are always instanced, and drawn for
+		// both eyes at once in single-pass stereo.
+		skyboxShaders = std::make_unique<ShaderVariants>("sky.vert", "skybox.frag",
+			std::vector<std::string>{ "STEREO_RESIDUAL" });
+		cubeShaders = std::make_unique<ShaderVariants>("skybox.vert", "skybox.frag",
+			std::vector<std::string>{ "STEREO" }, std::vector<std::string>{ "INSTANCED" });
+		if (multiview) {
+			multiviewCubeShaders = std::make_unique<ShaderVariants>("skybox.vert", "skybox.frag",
+				std::vector<std::string>{}, std::vector<std::string>{ "INSTANCED", "MULTIVIEW" });
 		}
 
-		// link and use it
-		prog.Use();
-
 		sphere.Bind();
 		vertices.Bind(Buffer::Target::Array);
 		{
@@ -870,42 +1082,138 @@ public:
 		instance_positions.push_back(glm::translate(glm::mat4(1.0f), glm::vec3(0, 0, -0.9)));
 
 		instanceCount = instance_positions.size();
+		for (GLuint i = 0; i < instanceCount; i++) {
+			bounds.add(BoundingBox());
+		}
+		cursorBounds = bounds.add(BoundingBox());
 
-		// Shader Program
-		shaderID = LoadShaders("skybox.vert", "skybox.frag");
-
-		cube = std::make_unique<TexturedCube>("cube");
+		// Textures stream in over the next frames; until then these draw with a placeholder
+		cube = std::make_unique<TexturedCube>(textures.acquire("./cube/"));
 
-		// 10m wide sky box: size doesn't matter though
-		skybox = std::make_unique<Skybox>("skybox");
-		skybox_right = std::make_unique<Skybox>("skybox_righteye");
+		// Drawn at infinity, so it has no size
+		skybox = std::make_unique<Skybox>(textures.acquire("./skybox/"));
 
-		skybox->toWorld = glm::scale(glm::mat4(1.0f), glm::vec3(5.0f));
-		skybox_right->toWorld = glm::scale(glm::mat4(1.0f), glm::vec3(5.0f));
+		// A right eye baked with --bake-stereo is the left eye plus a quarter-size residual
+		std::string rightResidual = residualPathFor("./skybox_righteye/");
+		Asset probe;
+		if (openAsset(ktxPathFor(rightResidual), probe))
+		{
+			skybox_right = std::make_unique<Skybox>(skybox->cubeMap, textures.acquire(rightResidual));
+		}
+		else
+		{
+			skybox_right = std::make_unique<Skybox>(textures.acquire("./skybox_righteye/"));
+		}
 
 
 	}
 
-	void renderSphere(const mat4 & model, const vec4 & color) {
-		prog.Use();
-		Uniform<mat4>(prog, "ModelMatrix").Set(model);
-		Uniform<vec4>(prog, "color").Set(color);
-		sphere.Bind();
-		sphereInstr.Draw(sphereIndices);
+	// The cubemaps each x_pressed mode draws, in the order render() uses them
+	std::vector<std::vector<std::shared_ptr<Cubemap>>> texturesByMode() const
+	{
+		// A residual right eye draws the left eye's cubemap plus its residual
+		std::shared_ptr<Cubemap> rightEye = skybox_right->residual ? skybox_right->residual : skybox_right->cubeMap;
+		return {
+			{ cube->cubeMap, skybox->cubeMap, rightEye }, // entire scene in stereo
+			{ skybox->cubeMap, rightEye },                // stereo skybox only
+			{ skybox->cubeMap },                          // mono skybox only
+		};
 	}
 
-  void render(const glm::mat4& projection, const glm::mat4& view, const int whichEye, const int x_pressed, const float cubeScale, const int b_pressed, const glm::mat3& rot, const glm::vec4& pos, const vec3 & right)
-  {
+	// The cursor as a packet; cursorModel says where it goes
+	DrawPacket spherePacket() {
+		GLuint sphereName = sphereProgram->get();
+		if (!sphereName) {
+			FAIL("Failed to build the sphere program");
+		}
+		if (sphereUniformProgram != sphereName) {
+			const ProgramReflection& reflection = ProgramReflection::of(sphereName);
+			ProgramInterface expected;
+			expected.uniforms = { { "ModelMatrix", GL_FLOAT_MAT4 }, { "color", GL_FLOAT_VEC4 } };
+			// The oglplus position array set up in the constructor. sphere.frag
+			// never reads the normal, so the linker may drop it as inactive.
+			expected.attributes = { { "position", 0 } };
+			reflection.verify("sphere", expected);
+			uSphereModel = reflection.mat4("ModelMatrix");
+			uSphereColor = reflection.vec4("color");
+			sphereUniformProgram = sphereName;
+		}
+		DrawPacket packet;
+		packet.program = sphereName;
+		packet.vertexArray = GetGLName(sphere);
+		packet.position = vec3(cursorModel[3]);
+		packet.cullIndex = cursorBounds;
+		packet.draw = drawSphere;
+		packet.object = this;
+		return packet;
+	}
 
-	  // render cursor
-	  mat4 S = glm::scale(vec3(0.07 / 2.0f));
-	  mat4 rightCursor = glm::translate(mat4(1), right) * S;
+	static void drawSphere(const DrawPacket & packet, const mat4 & projection, const mat4 & view) {
+		Scene* scene = static_cast<Scene*>(packet.object);
+		scene->uSphereModel.set(scene->cursorModel);
+		scene->uSphereColor.set(vec4(0, 0, 1, 0));
+		scene->sphereInstr.Draw(scene->sphereIndices);
+	}
 
+  // Never blocks. Until the driver has finished every program (which
+  // PendingProgram::ready() can only tell with KHR_parallel_shader_compile;
+  // without it this waits right away), the eyes are left cleared, so the
+  // compiles overlap the first frames and the texture loads.
+  bool programsReady()
+  {
+	  if (!programsVerified) {
+		  bool ready = sphereProgram->ready() && skyboxShaders->ready() && cubeShaders->ready() &&
+			  (!multiviewCubeShaders || multiviewCubeShaders->ready());
+		  if (!ready) {
+			  return false;
+		  }
+	  }
+	  resolvePrograms();
+	  return true;
+  }
 
-	  vec4 rightCursorCorlor = vec4(0, 0, 1, 0);
+  // Takes the programs, which are only waited on (and verified) the first time
+  void resolvePrograms()
+  {
+	  shaderID = skyboxShaders->get(0);
+	  rightSkyboxShaderID = skybox_right->residual ? skyboxShaders->get(skyboxShaders->flag("STEREO_RESIDUAL")) : shaderID;
+	  cubeShaderID = cubeShaders->get(0);
+	  stereoCubeShaderID = cubeShaders->get(cubeShaders->flag("STEREO"));
+	  multiviewCubeShaderID = multiviewCubeShaders ? multiviewCubeShaders->get(0) : 0;
+	  if (!programsVerified) {
+		  verifyPrograms();
+		  programsVerified = true;
+		  // Every program has loaded by now, so this is the whole startup's count
+		  ProgramCache::Stats cache = ProgramCache::shared().stats();
+		  std::cout << "Program cache: " << cache.hits << " hits, " << cache.misses << " misses, "
+			  << cache.rejected << " rejected by the driver" << std::endl;
+	  }
+  }
 
-	  renderSphere(rightCursor, rightCursorCorlor);
+  // Reports, as soon as they have linked, any program whose interface doesn't
+  // match what the C++ side sets and feeds it
+  void verifyPrograms()
+  {
+	  bool matched = true;
+	  // A program that failed to link (0) has had its errors reported already
+	  auto verify = [&](GLuint program, const char* label, const ProgramInterface& expected) {
+		  matched = program && ProgramReflection::of(program).verify(label, expected) && matched;
+	  };
+	  verify(shaderID, "sky", Skybox::skyInterface(false));
+	  if (rightSkyboxShaderID != shaderID) {
+		  verify(rightSkyboxShaderID, "sky STEREO_RESIDUAL", Skybox::skyInterface(true));
+	  }
+	  verify(cubeShaderID, "cube", TexturedCube::instancedInterface(false, Attribute::InstanceTransform));
+	  verify(stereoCubeShaderID, "cube STEREO", TexturedCube::instancedInterface(true, Attribute::InstanceTransform));
+	  if (multiviewCubeShaders) {
+		  verify(multiviewCubeShaderID, "cube MULTIVIEW", TexturedCube::instancedInterface(true, Attribute::InstanceTransform));
+	  }
+	  std::cout << "Program interfaces " << (matched ? "match the C++ side" : "DON'T match the C++ side; see above") << std::endl;
+  }
 
+  // Sets drawView from the head's view and the b_pressed mode
+  void updateDrawView(const glm::mat4& view, const int b_pressed, const glm::mat3& rot, const glm::vec4& pos)
+  {
 	  if (b_pressed == 0) {
 		  //ldrawView = view;
 		  //rdrawView = view;
@@ -954,55 +1262,174 @@ public:
 		  drawView = glm::mat4(rot);
 		  drawView[3] = pos;
 	  }
+  }
 
-	  //Entire scene in stereo
-	  if (x_pressed == 0) {
-		  // Render two cubes
-		  for (int i = 0; i < instanceCount; i++)
-		  {
-			  // Scale to 20cm: 200cm * 0.1
-			  cube->toWorld = instance_positions[i] * glm::scale(glm::mat4(1.0f), glm::vec3(0.15f + 0.1*cubeScale));
-			  if (whichEye == 0) {
-				  cube->draw(shaderID, projection, drawView);
-			  }
+  // The cube transforms only change with the scale, so every eye (and frame) shares them
+  void updateInstances(const float cubeScale)
+  {
+	  if (cubeScale == instancedCubeScale) {
+		  return;
+	  }
+	  // The mesh spans -1 to 1 on every axis
+	  BoundingBox unitCube;
+	  unitCube.center = vec3(0.0f);
+	  unitCube.extent = vec3(1.0f);
+	  instanceTransforms.resize(instanceCount);
+	  for (GLuint i = 0; i < instanceCount; i++)
+	  {
+		  // Scale to 20cm: 200cm * 0.1
+		  instanceTransforms[i] = instance_positions[i] * glm::scale(glm::mat4(1.0f), glm::vec3(0.15f + 0.1*cubeScale));
+		  bounds.set(i, BoundingBox::transformed(unitCube, instanceTransforms[i]));
+	  }
+	  instancedCubeScale = cubeScale;
+	  instancesChanged = true;
+  }
 
-			  if (whichEye == 1) {
-				  cube->draw(shaderID, projection, drawView);
-			  }
+  // Puts the instances in 'visibleObjects' (CullSet indices, ascending) in
+  // the instance buffer, unless it already holds just those
+  void uploadInstances(const std::vector<uint32_t>& visibleObjects)
+  {
+	  std::vector<uint32_t> instances;
+	  for (uint32_t index : visibleObjects) {
+		  if (index < instanceCount) {
+			  instances.push_back(index);
 		  }
+	  }
+	  if (!instancesChanged && instances == uploadedInstances) {
+		  return;
+	  }
+	  std::vector<glm::mat4> transforms;
+	  for (uint32_t index : instances) {
+		  transforms.push_back(instanceTransforms[index]);
+	  }
+	  cube->setInstances(transforms, Attribute::InstanceTransform);
+	  uploadedInstances.swap(instances);
+	  instancesChanged = false;
+  }
 
-		  // Render Skybox : remove view translation
-		  if (whichEye == 0) {
-			  skybox->draw(shaderID, projection, drawView);
-		  }
-		  if (whichEye == 1) {
-			  skybox_right->draw(shaderID, projection, drawView);
-		  }
+  // Fills visible[] for 'eyeCount' eyes; with two, the objects neither eye
+  // can see are dropped in one pass before each eye is refined
+  void cullEyes(const glm::mat4 projections[], const glm::mat4 views[], const int eyeCount)
+  {
+	  ViewFrustum frusta[2];
+	  for (int eye = 0; eye < eyeCount; eye++) {
+		  frusta[eye] = ViewFrustum::fromMatrix(projections[eye] * views[eye]);
 	  }
+	  bounds.cull(frusta, eyeCount, visible);
+  }
 
-	  //Stereo skybox only
-	  if (x_pressed == 1) {
+  // Draws the cursor at 'right' from the next replay on, culled as a box
+  // that takes in both 'right' and 'other'
+  void placeCursor(const vec3 & right, const vec3 & other)
+  {
+	  const float radius = 0.07f / 2.0f;
+	  cursorModel = glm::translate(mat4(1), right) * glm::scale(vec3(radius));
+	  BoundingBox cursor;
+	  cursor.center = (right + other) * 0.5f;
+	  cursor.extent = glm::abs(right - other) * 0.5f + vec3(radius);
+	  bounds.set(cursorBounds, cursor);
+  }
 
-		  // Render Skybox : remove view translation
-		  if (whichEye == 0) {
-			  skybox->draw(shaderID, projection, drawView);
-		  }
-		  if (whichEye == 1) {
-			  skybox_right->draw(shaderID, projection, drawView);
-		  }
+  // Submits and sorts this frame's draws for the x_pressed mode, with depths
+  // taken from 'viewpoint'. 'withCubes' false leaves the cubes to the caller.
+  void buildQueue(const int x_pressed, const float cubeScale, const vec3 & right, const bool withCubes, const vec3 & viewpoint)
+  {
+	  queue.beginFrame();
+
+	  // render cursor
+	  placeCursor(right, right);
+	  queue.submit(spherePacket());
+
+	  // Render every cube in one instanced draw
+	  if (x_pressed == 0 && withCubes) {
+		  updateInstances(cubeScale);
+		  queue.submit(cube->instancedPacket(cubeShaderID, DrawPacket::BOTH_EYES));
+	  }
+
+	  // Entire scene in stereo and stereo skybox only: each eye its own skybox
+	  if (x_pressed == 0 || x_pressed == 1) {
+		  queue.submit(skybox->packet(shaderID, DrawPacket::LEFT_EYE));
+		  queue.submit(skybox_right->packet(rightSkyboxShaderID, DrawPacket::RIGHT_EYE));
 	  }
 
 	  //Mono skybox only
 	  if (x_pressed == 2) {
-		
-		  if (whichEye == 0) {
-			  skybox->draw(shaderID, projection, drawView);
-		  }
-		  if (whichEye == 1) {
-			  skybox->draw(shaderID, projection, drawView);
-		  }
+		  queue.submit(skybox->packet(shaderID, DrawPacket::BOTH_EYES));
 	  }
 
+	  queue.sort(viewpoint);
+  }
+
+  // The first eye of each frame builds the queue; every eye replays it
+  void render(const glm::mat4& projection, const glm::mat4& view, const int whichEye, const unsigned int frame, const int x_pressed, const float cubeScale, const int b_pressed, const glm::mat3& rot, const glm::vec4& pos, const vec3 & right)
+  {
+	  if (!programsReady()) {
+		  return;
+	  }
+	  updateDrawView(view, b_pressed, rot, pos);
+
+	  if (frame != queuedFrame) {
+		  buildQueue(x_pressed, cubeScale, right, true, vec3(glm::inverse(drawView)[3]));
+		  queuedFrame = frame;
+	  }
+	  // Each eye takes its own place in the cursor trail, even when it replays
+	  // a queue built for the other
+	  placeCursor(right, right);
+	  // Eye by eye, only this one is known, so it is culled on its own
+	  cullEyes(&projection, &drawView, 1);
+	  if (x_pressed == 0) {
+		  uploadInstances(visible[0]);
+	  }
+	  queue.replay(projection, drawView, whichEye, &visible[0]);
+  }
+
+  // render() for both eyes at once, side by side or into the layers of
+  // 'multiview'. The cubes go out in a single draw for both eyes; the cursor
+  // and the skyboxes, which differ per eye, are replayed from the queue once per eye.
+  // 'rights' holds each eye's cursor position, as render() would get it.
+  void renderStereo(const glm::mat4 projections[2], const glm::mat4 views[2], const int whichEyes[2], const glm::vec4 viewports[2], const int targetWidth, const int targetHeight, MultiviewTarget* multiview, const unsigned int frame, const int x_pressed, const float cubeScale, const int b_pressed, const glm::mat3& rot, const glm::vec4& pos, const vec3 rights[2])
+  {
+	  if (!programsReady()) {
+		  return;
+	  }
+
+	  glm::mat4 eyeViews[2];
+	  for (int eye = 0; eye < 2; eye++) {
+		  updateDrawView(views[eye], b_pressed, rot, pos);
+		  eyeViews[eye] = drawView;
+	  }
+	  buildQueue(x_pressed, cubeScale, rights[0], false, vec3(glm::inverse(eyeViews[0])[3]));
+	  queuedFrame = frame;
+
+	  // Both eyes are culled at once, so the cursor's box spans both its places
+	  placeCursor(rights[0], rights[1]);
+	  updateInstances(cubeScale);
+	  cullEyes(projections, eyeViews, 2);
+
+	  stereo.setTarget(multiview);
+	  if (x_pressed == 0) {
+		  // One draw covers both eyes, so it takes every cube either eye sees
+		  std::vector<uint32_t> eitherEye;
+		  std::set_union(visible[0].begin(), visible[0].end(), visible[1].begin(), visible[1].end(),
+			  std::back_inserter(eitherEye));
+		  uploadInstances(eitherEye);
+		  stereo.setEyes(projections, eyeViews, viewports, targetWidth, targetHeight);
+		  GpuScope cubes("stereo cubes");
+		  stereo.begin();
+		  cube->drawStereoInstanced(multiview ? multiviewCubeShaderID : stereoCubeShaderID, stereo);
+		  stereo.end();
+	  }
+
+	  for (int eye = 0; eye < 2; eye++) {
+		  stereo.beginEye(eye, viewports[eye]);
+		  placeCursor(rights[eye], rights[1 - eye]);
+		  queue.replay(projections[eye], eyeViews[eye], whichEyes[eye], &visible[eye]);
+	  }
+  }
+
+  RenderQueue::Stats queueStats() const
+  {
+	  return queue.lastFrame();
   }
 
 };
@@ -1012,6 +1439,10 @@ public:
 // An example application that renders a simple cube
 class ExampleApp : public RiftApp
 {
+  // Outlives the scene so a rebuilt scene finds its textures still resident
+  std::unique_ptr<TextureCache> textures;
+  std::unique_ptr<ResidencyManager> residency;
+  std::unique_ptr<ModePrefetcher> prefetcher;
   std::shared_ptr<Scene> scene;
 
 public:
@@ -1065,15 +1496,63 @@ protected:
     glClearColor(0.2f, 0.2f, 0.2f, 0.0f);
     glEnable(GL_DEPTH_TEST);
     ovr_RecenterTrackingOrigin(_session);
-    scene = std::shared_ptr<Scene>(new Scene());
+    textures = std::make_unique<TextureCache>();
+    residency = std::make_unique<ResidencyManager>(*textures);
+    scene = std::shared_ptr<Scene>(new Scene(*textures, usingMultiview()));
+    prefetcher = std::make_unique<ModePrefetcher>(scene->texturesByMode());
   }
 
   void shutdownGl() override
   {
+    prefetcher.reset();
     scene.reset();
+    residency.reset();
+    textures.reset();
+    RiftApp::shutdownGl();
+  }
+
+  void onKey(int key, int scancode, int action, int mods) override
+  {
+    if (GLFW_PRESS == action && GLFW_KEY_Q == key && scene)
+    {
+      RenderQueue::Stats stats = scene->queueStats();
+      std::cout << "Render queue: " << stats.packets << " packets, " << stats.draws << " draws, " << stats.culled
+                << " culled, " << stats.stateChanges << " state changes, sorted in " << stats.sortMilliseconds
+                << " ms last frame" << std::endl;
+      return;
+    }
+    RiftApp::onKey(key, scancode, action, mods);
+  }
+
+  void update() override
+  {
+    prefetcher->update(x_pressed);
+    residency->update();
+    textures->update();
   }
 
   void renderScene(const glm::mat4& projection, const glm::mat4& headPose, const int whichEye) override
+  {
+	  vec3 right;
+	  glm::mat4 view = trackedView(headPose, whichEye, right);
+	  scene->render(projection, view, whichEye, frame, x_pressed, cubeScale, b_pressed, rotation, position, right);
+  }
+
+  void renderStereoScene(const glm::mat4 projections[2], const glm::mat4 headPoses[2], const int whichEyes[2],
+                         const glm::vec4 viewports[2], const uvec2& targetSize, MultiviewTarget* multiview) override
+  {
+	  // The head tracking, input and lag handling still runs per eye, as in renderScene
+	  vec3 rights[2];
+	  glm::mat4 views[2];
+	  for (int eye = 0; eye < 2; eye++) {
+		  views[eye] = trackedView(headPoses[eye], whichEyes[eye], rights[eye]);
+	  }
+	  scene->renderStereo(projections, views, whichEyes, viewports, targetSize.x, targetSize.y, multiview, frame, x_pressed, cubeScale, b_pressed, rotation, position, rights);
+  }
+
+  // Polls the controllers and returns the view of 'whichEye', after any
+  // tracking lag or rendering delay; 'right' is the cursor position to draw
+  glm::mat4 trackedView(const glm::mat4& headPose, const int whichEye, vec3& right)
   {	  
 	  if (whichEye == 0) {
 		  lringBuffer.pop_front();
@@ -1102,7 +1581,6 @@ protected:
 
 	  ovrVector3f handPosition[2];
 	  handPosition[1] = handPoses[1].Position;
-	  vec3 right;
 	  right = vec3(handPosition[1].x, handPosition[1].y, handPosition[1].z);
 
 	  cringBuffer.pop_front();
@@ -1290,7 +1768,7 @@ protected:
 		  outputFrame = renderFrame;
 	  }
 
-	  scene->render(projection, glm::inverse(outputFrame), whichEye, x_pressed, cubeScale, b_pressed, rotation, position, right);
+	  return glm::inverse(outputFrame);
   }
 };
 
@@ -1300,11 +1778,49 @@ int main(int argc, char** argv)
 {
 	int result = -1;
 
+	// Packing reads the loose files, so it has to happen before the old pack is mounted
+	if (argc > 2 && std::string(argv[1]) == "--pack")
+	{
+		return packAssets(argv[2], std::vector<std::string>(argv + 3, argv + argc));
+	}
+
+	// Everything below loads out of the pack when there is one
+	if (AssetPack::shared().mount("assets.pack"))
+	{
+		std::cout << "Mounted assets.pack (" << AssetPack::shared().entryCount() << " assets)" << std::endl;
+	}
+
+	// CPU-side benchmarks and asset tools run without the HMD
+	if (argc > 2 && std::string(argv[1]) == "--bench")
+	{
+		return runBenchmark(argv[2]);
+	}
+
+	if (argc > 2 && std::string(argv[1]) == "--bake")
+	{
+		BlockFormat format = BlockFormat::BC7;
+		if (argc > 3 && !parseBlockFormat(argv[3], format))
+		{
+			std::cerr << "unknown block format " << argv[3] << ", expected bc1 or bc7" << std::endl;
+			return -1;
+		}
+		return bakeCubemap(argv[2], format);
+	}
+
+	if (argc > 3 && std::string(argv[1]) == "--bake-stereo")
+	{
+		bool force = argc > 4 && std::string(argv[4]) == "force";
+		return bakeStereoResidual(argv[2], argv[3], force);
+	}
+
 	if (!OVR_SUCCESS(ovr_Initialize(nullptr)))
 	{
 		FAIL("Failed to initialize the Oculus SDK");
 	}
-	result = ExampleApp().run();
+	// --multiview renders both eyes in one pass with OVR_multiview2 where the driver has it
+	ExampleApp app;
+	app.requestMultiview(argc > 1 && std::string(argv[1]) == "--multiview");
+	result = app.run();
 
 	//ovr_Shutdown();
 	return result;
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -15,107 +16,183 @@ using namespace std;
 #include <GLFW/glfw3.h>
 
 #include "shader.h"
+#include "ProgramCache.h"
+#include "ShaderVariants.h"
 
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
-
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
-	}else{
-		printf("Impossible to open %s. Check to make sure the file exists and you passed in the right filepath!\n", vertex_file_path);
-		printf("The current working directory is:");
-#ifdef _WIN32
-		system("CD");
-#else
-		system("pwd");
+// KHR_parallel_shader_compile postdates the GLEW we ship with
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
 #endif
-		getchar();
-		return 0;
+typedef void (APIENTRY * MaxShaderCompilerThreadsProc)(GLuint count);
+
+namespace {
+	const char * StageName(GLenum type){
+		switch(type){
+		case GL_VERTEX_SHADER: return "vertex";
+		case GL_FRAGMENT_SHADER: return "fragment";
+		case GL_GEOMETRY_SHADER: return "geometry";
+		default: return "shader";
+		}
 	}
 
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
+	// Looked up once, on the first submit, when the context is current
+	bool ParallelCompileSupported(){
+		static int Supported = -1;
+		if(Supported < 0){
+			Supported = 0;
+			GLint ExtensionCount = 0;
+			glGetIntegerv(GL_NUM_EXTENSIONS, &ExtensionCount);
+			for(GLint i = 0; i < ExtensionCount; i++){
+				const char * Extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+				if(Extension && (strcmp(Extension, "GL_KHR_parallel_shader_compile") == 0 ||
+				                 strcmp(Extension, "GL_ARB_parallel_shader_compile") == 0)){
+					Supported = 1;
+				}
+			}
+			if(Supported){
+				// Let the driver pick how many compiler threads to use
+				MaxShaderCompilerThreadsProc MaxThreads =
+					(MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+				if(!MaxThreads){
+					MaxThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+				}
+				if(MaxThreads){
+					MaxThreads(0xFFFFFFFF);
+				}
+				printf("Compiling shaders in parallel (KHR_parallel_shader_compile)\n");
+			}
+		}
+		return Supported == 1;
 	}
 
-	GLint Result = GL_FALSE;
-	int InfoLogLength;
+	// The file with its #includes expanded, as ShaderVariants reads it, so the
+	// shaders that share vertex_inputs.glsl load through either path
+	bool ReadSource(const char * file_path, std::string & Code){
+		std::vector<std::string> Files;
+		std::string Error;
+		if(!expandIncludes(file_path, Code, Files, Error)){
+			printf("Impossible to read %s (%s). Check to make sure the file exists and you passed in the right filepath!\n", file_path, Error.c_str());
+			return false;
+		}
+		return true;
+	}
+}
 
+bool PendingProgram::ready() const {
+	if(resolved || !ParallelCompileSupported()){
+		return true;
+	}
+	GLint Complete = GL_FALSE;
+	glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &Complete);
+	return Complete == GL_TRUE;
+}
+
+GLuint PendingProgram::get(){
+	if(resolved){
+		return failed ? 0 : program;
+	}
+	resolved = true;
 
-	// Compile Vertex Shader
-	printf("Compiling shader : %s\n", vertex_file_path);
-	char const * VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
-	glCompileShader(VertexShaderID);
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
 
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> VertexShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-		printf("%s\n", &VertexShaderErrorMessage[0]);
+	// Only the first status query waits; the stage logs are read only when
+	// something went wrong, since each of those is another wait
+	glGetProgramiv(program, GL_LINK_STATUS, &Result);
+	if(Result != GL_TRUE){
+		for(GLuint ShaderID : shaders){
+			GLint Type = 0;
+			glGetShaderiv(ShaderID, GL_SHADER_TYPE, &Type);
+			glGetShaderiv(ShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+			if ( InfoLogLength > 0 ){
+				std::vector<char> ShaderErrorMessage(InfoLogLength+1);
+				glGetShaderInfoLog(ShaderID, InfoLogLength, NULL, &ShaderErrorMessage[0]);
+				printf("%s (%s): %s\n", name.c_str(), StageName(Type), &ShaderErrorMessage[0]);
+			}
+		}
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &InfoLogLength);
+		if ( InfoLogLength > 0 ){
+			std::vector<char> ProgramErrorMessage(InfoLogLength+1);
+			glGetProgramInfoLog(program, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+			printf("%s: %s\n", name.c_str(), &ProgramErrorMessage[0]);
+		}
+		failed = true;
 	}
 	else {
-		printf("Successfully compiled vertex shader!\n");
+		printf("Linked program %s\n", name.c_str());
+		ProgramCache::shared().store(program, cacheKey);
 	}
 
+	for(GLuint ShaderID : shaders){
+		glDetachShader(program, ShaderID);
+		glDeleteShader(ShaderID);
+	}
+	shaders.clear();
 
+	// Nobody else will ever see a program of our own that failed
+	if(failed && ownsProgram){
+		glDeleteProgram(program);
+		program = 0;
+	}
 
-	// Compile Fragment Shader
-	printf("Compiling shader : %s\n", fragment_file_path);
-	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-	glCompileShader(FragmentShaderID);
+	return failed ? 0 : program;
+}
 
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> FragmentShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-		printf("%s\n", &FragmentShaderErrorMessage[0]);
+std::shared_ptr<PendingProgram> SubmitProgram(const std::string & name, const std::vector<ShaderStage> & stages, GLuint program){
+	ParallelCompileSupported();
+
+	std::shared_ptr<PendingProgram> Pending = std::make_shared<PendingProgram>();
+	Pending->name = name;
+	if(stages.empty()){
+		// What a program whose sources couldn't be read is submitted as
+		Pending->program = program;
+		Pending->resolved = true;
+		Pending->failed = true;
+		return Pending;
 	}
-	else {
-		printf("Successfully compiled fragment shader!\n");
+	Pending->ownsProgram = program == 0;
+	Pending->program = program ? program : glCreateProgram();
+
+	// A binary from an earlier run skips compiling and linking entirely
+	std::vector<std::string> Sources;
+	for(const ShaderStage & Stage : stages){
+		Sources.push_back(Stage.source);
+	}
+	Pending->cacheKey = ProgramCache::shared().key(Sources);
+	if(ProgramCache::shared().load(Pending->program, Pending->cacheKey)){
+		printf("Loaded program %s from the shader cache\n", name.c_str());
+		Pending->resolved = true;
+		return Pending;
 	}
 
+	// Hand everything to the driver without asking how it went
+	for(const ShaderStage & Stage : stages){
+		GLuint ShaderID = glCreateShader(Stage.type);
+		char const * SourcePointer = Stage.source.c_str();
+		glShaderSource(ShaderID, 1, &SourcePointer, NULL);
+		glCompileShader(ShaderID);
+		glAttachShader(Pending->program, ShaderID);
+		Pending->shaders.push_back(ShaderID);
+	}
+	glProgramParameteri(Pending->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(Pending->program);
+	return Pending;
+}
+
+std::shared_ptr<PendingProgram> LoadShadersAsync(const char * vertex_file_path,const char * fragment_file_path){
+	std::string Name = std::string(vertex_file_path) + " + " + fragment_file_path;
 
-	// Link the program
-	printf("Linking program\n");
-	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
-	glLinkProgram(ProgramID);
-
-	// Check the program
-	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> ProgramErrorMessage(InfoLogLength+1);
-		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-		printf("%s\n", &ProgramErrorMessage[0]);
+	// Read the shader code from the files (out of the mounted asset pack when
+	// it has them). A missing file fails the program instead of waiting for
+	// input, so a headless run doesn't hang.
+	std::string VertexShaderCode, FragmentShaderCode;
+	if(!ReadSource(vertex_file_path, VertexShaderCode) || !ReadSource(fragment_file_path, FragmentShaderCode)){
+		return SubmitProgram(Name, {});
 	}
-	
-	glDetachShader(ProgramID, VertexShaderID);
-	glDetachShader(ProgramID, FragmentShaderID);
-	
-	glDeleteShader(VertexShaderID);
-	glDeleteShader(FragmentShaderID);
-
-	return ProgramID;
+
+	return SubmitProgram(Name, { { GL_VERTEX_SHADER, VertexShaderCode }, { GL_FRAGMENT_SHADER, FragmentShaderCode } });
+}
+
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
+	return LoadShadersAsync(vertex_file_path, fragment_file_path)->get();
 }
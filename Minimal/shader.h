@@ -1,6 +1,56 @@
 #ifndef SHADER_H
 #define SHADER_H
 
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct ShaderStage
+{
+	GLenum type;
+	std::string source;
+};
+
+// A program whose stages were handed to the driver without waiting for them.
+// Nothing queries compile or link status until the program is first needed, so
+// drivers with KHR_parallel_shader_compile (or that compile lazily anyway)
+// build every program of a batch on their own threads.
+class PendingProgram
+{
+public:
+	// Never blocks; false while the driver is known to be still compiling or
+	// linking. Without KHR_parallel_shader_compile that can't be known without
+	// waiting, so it is true and get() does the waiting.
+	bool ready() const;
+
+	// Waits for the link on the first call and reports any errors. Returns the
+	// program, or 0 when it failed to build (a program SubmitProgram created is
+	// then deleted).
+	GLuint get();
+
+private:
+	friend std::shared_ptr<PendingProgram> SubmitProgram(const std::string&, const std::vector<ShaderStage>&, GLuint);
+
+	std::string name;
+	GLuint program{0};
+	bool ownsProgram{false}; // created by SubmitProgram rather than passed in
+	std::vector<GLuint> shaders;
+	uint64_t cacheKey{0};
+	bool resolved{false};
+	bool failed{false};
+};
+
+// Compiles and links 'stages' into 'program' (a new one when 0) without
+// waiting, unless the shader cache already holds its binary. No stages at all
+// gives a program that has already failed.
+std::shared_ptr<PendingProgram> SubmitProgram(const std::string& name, const std::vector<ShaderStage>& stages,
+                                              GLuint program = 0);
+
+// Reads both files (from the asset pack when it has them) and submits them
+std::shared_ptr<PendingProgram> LoadShadersAsync(const char * vertex_file_path,const char * fragment_file_path);
+
+// LoadShadersAsync, waited on
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path);
 
 #endif
@@ -6,8 +6,7 @@
 // called when the vertex shader gets run.
 // The vertex shader gets called once per vertex.
 
-layout (location = 0) in vec3 position;
-layout (location = 1) in vec3 normal;
+#include "vertex_inputs.glsl"
 
 // Uniform variables can be updated by fetching their location and passing values to that location
 uniform mat4 projection;
@@ -0,0 +1,21 @@
+#version 410 core
+
+// The sky at infinity, as one triangle covering the whole viewport. It sits on
+// the far plane, so with GL_LEQUAL only the pixels nothing else has covered
+// run the fragment shader (skybox.frag).
+
+out vec3 TexCoords;
+
+// Of projection * view, with the view's translation removed
+uniform mat4 inverseViewProjection;
+
+void main()
+{
+    // Vertices 0, 1 and 2 at (-1,-1), (3,-1) and (-1,3): the viewport and then some
+    vec2 ndc = vec2((gl_VertexID & 1) * 4 - 1, (gl_VertexID & 2) * 2 - 1);
+    gl_Position = vec4(ndc, 1.0, 1.0);
+    // The world direction through this point of the far plane. Its w is the
+    // same all across that plane (and 0 for an infinite far plane), so the
+    // unprojected xyz interpolates straight to the direction of every pixel.
+    TexCoords = (inverseViewProjection * vec4(ndc, 1.0, 1.0)).xyz;
+}
@@ -8,9 +8,20 @@ in vec3 TexCoords;
 
 uniform samplerCube skybox;
 
+#ifdef STEREO_RESIDUAL
+// A stereo eye stored as a residual against the other eye's cubemap in
+// 'skybox': each texel holds (eye - base) / residualScale + 128
+uniform samplerCube residual;
+uniform float residualScale;
+#endif
+
 out vec4 fragColor;
 
 void main()
 {    
     fragColor = texture(skybox, TexCoords);
+#ifdef STEREO_RESIDUAL
+    vec3 delta = (texture(residual, TexCoords).rgb - 128.0 / 255.0) * residualScale;
+    fragColor.rgb = clamp(fragColor.rgb + delta, 0.0, 1.0);
+#endif
 }
@@ -6,8 +6,8 @@
 // called when the vertex shader gets run.
 // The vertex shader gets called once per vertex.
 
-layout (location = 0) in vec3 position;
-layout (location = 1) in vec3 normal;
+#include "stereo_eyes.glsl"
+#include "vertex_inputs.glsl"
 
 out vec3 TexCoords;
 
@@ -17,6 +17,15 @@ uniform mat4 view;
 void main()
 {
     TexCoords = position;
-    gl_Position = projection * view * vec4(position, 1.0);
-    //gl_Position = pos.xyww;
+#ifdef INSTANCED
+    vec4 world = instanceTransform * vec4(position, 1.0);
+#else
+    vec4 world = vec4(position, 1.0);
+#endif
+#if defined(STEREO) || defined(MULTIVIEW)
+    int eye = stereoEye();
+    gl_Position = toEyeViewport(eyeProjection[eye] * eyeView[eye] * world, eye);
+#else
+    gl_Position = projection * view * world;
+#endif
 }  
\ No newline at end of file
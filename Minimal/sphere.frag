@@ -0,0 +1,9 @@
+#version 410 core
+
+uniform vec4 color = vec4(1);
+in vec3 vertNormal;
+out vec4 fragColor;
+
+void main(void) {
+    fragColor = color;
+}
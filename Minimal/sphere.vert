@@ -0,0 +1,14 @@
+#version 410 core
+
+#include "vertex_inputs.glsl"
+
+uniform mat4 ProjectionMatrix = mat4(1);
+uniform mat4 ViewMatrix = mat4(1);
+uniform mat4 ModelMatrix = mat4(1);
+
+out vec3 vertNormal;
+
+void main(void) {
+   vertNormal = normal;
+   gl_Position = ProjectionMatrix * ViewMatrix * ModelMatrix * vec4(position, 1.0);
+}
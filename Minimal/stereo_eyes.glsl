@@ -0,0 +1,41 @@
+#ifdef MULTIVIEW
+// Both eyes as the two views of a GL_OVR_multiview2 framebuffer. An #extension
+// has to come before any declarations, so include this file first.
+#extension GL_OVR_multiview2 : require
+layout (num_views = 2) in;
+#endif
+
+#if defined(STEREO) || defined(MULTIVIEW)
+// Both eyes in one pass (StereoPass on the C++ side). With STEREO even
+// instances draw the left eye of the side-by-side target and odd ones the
+// right; with MULTIVIEW every draw reaches both eyes' layers.
+layout (std140) uniform StereoEyes
+{
+    mat4 eyeProjection[2];
+    mat4 eyeView[2];
+    vec4 eyeViewport[2]; // NDC scale in xy, offset in zw
+};
+
+int stereoEye()
+{
+#ifdef MULTIVIEW
+    return int(gl_ViewID_OVR);
+#else
+    return gl_InstanceID & 1;
+#endif
+}
+
+// Moves a clip-space position from the eye's own viewport into its part of
+// the whole target. Side by side, it is also clipped to that part; a layer
+// holds nothing but its eye, so there is nothing to clip against.
+vec4 toEyeViewport(vec4 clip, int eye)
+{
+    vec4 viewport = eyeViewport[eye];
+    clip.xy = clip.xy * viewport.xy + viewport.zw * clip.w;
+#ifndef MULTIVIEW
+    gl_ClipDistance[0] = clip.x - (viewport.z - viewport.x) * clip.w;
+    gl_ClipDistance[1] = (viewport.z + viewport.x) * clip.w - clip.x;
+#endif
+    return clip;
+}
+#endif
@@ -0,0 +1,10 @@
+// The attribute layout of every mesh: position in slot 0, normal in slot 1,
+// texture coordinate in slot 2 (see CubeMesh)
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec2 uv;
+
+#ifdef INSTANCED
+// One model transform per instance, in slots 5-8 (Attribute::InstanceTransform)
+layout (location = 5) in mat4 instanceTransform;
+#endif